@@ -22,7 +22,8 @@ int sockfd;
 struct sockaddr_in servaddr;
 socklen_t len = sizeof(servaddr);
 
-#define TIMEOUT_USEC 500000 // 0.5s timeout
+#define RTO_INIT_USEC 500000 // initial timeout (0.5s), until the first RTT sample
+#include "udp_rto.h"            // adaptive timeout (RFC 6298), shared with the folder client
 
 // ---------------------- Receiver Thread ----------------------
 void *receive_data(void *args)
@@ -154,40 +155,58 @@ void *send_file(void *args)
             memcpy(packet + strlen(packet), buff, bytes);
 
             int ack_received = 0;// Acknowledgment flag
+            int attempts = 0;// Transmissions of this chunk (Karn's rule)
+            long sent_at;
             while (!ack_received)
             {
+                sent_at = rto_now_usec();
+                attempts++;
                 sendto(sockfd, packet, strlen(packet), 0, (const struct sockaddr *)&servaddr, len);
                 printf("[CLIENT] Sent chunk #%d (seq %d)\n", ++chunk_no, seq);
-		// Wait for ACK with timeout
-                FD_ZERO(&readfds);
-                FD_SET(sockfd, &readfds);
-                tv.tv_sec = 0;
-                tv.tv_usec = TIMEOUT_USEC;
-
-                int rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
-                if (rv > 0)
+
+                // Wait out this RTO for the matching ACK: a stale or mismatched one does not end it
+                long waited;
+                while (!ack_received && (waited = rto_now_usec() - sent_at) < rto)
                 {
-                    // ACK received within timeout
+                    FD_ZERO(&readfds);
+                    FD_SET(sockfd, &readfds);
+                    tv.tv_sec = (rto - waited) / 1000000;
+                    tv.tv_usec = (rto - waited) % 1000000;// What is left of the adaptive timeout
+
+                    int rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
+                    if (rv < 0 && errno == EINTR)
+                        continue;
+                    if (rv <= 0)
+                        break;// Timeout
                     char ack[32];
-                    int n = recvfrom(sockfd, ack, sizeof(ack), 0, NULL, NULL);
+                    int n = recvfrom(sockfd, ack, sizeof(ack) - 1, 0, NULL, NULL);
+                    if (n <= 0)
+                        continue;
                     ack[n] = '\0';
                     int ack_seq;
-                    
+
                     // Validate ACK
                     if (sscanf(ack, "ACK:%d", &ack_seq) == 1 && ack_seq == seq)
                     {
                         ack_received = 1;// ACK matches
+                        if (attempts == 1)// only unambiguous RTTs feed the estimator
+                            rtt_sample(rto_now_usec() - sent_at);
                         seq = 1 - seq;// Flip sequence for next packet
                     }
                 }
-                else
-                    printf("[CLIENT] Timeout → retransmitting seq %d...\n", seq);// Timeout: resend the same packet
+                if (!ack_received)
+                {
+                    rto_backoff();// Exponential backoff, then resend the same packet
+                    printf("[CLIENT] Timeout → retransmitting seq %d (rto %ld us)...\n", seq, rto);
+                }
             }
         }
 
         fclose(fp);
         sendto(sockfd, FILE_END, strlen(FILE_END), 0, (const struct sockaddr *)&servaddr, len);
         printf("[CLIENT] File '%s' sent successfully!\n", filename);
+        printf("[CLIENT] RTT srtt=%ldus rttvar=%ldus rto=%ldus samples=%ld retransmissions=%ld\n",
+               srtt, rttvar, rto, rtt_samples, retransmissions);
     }
     return NULL;
 }
@@ -2,7 +2,7 @@
 // Full-Duplex UDP File Transfer Client (Version 4 - Logging + Resume)
 // Features:
 //   ✅ Logging of all transfers to 'transfer_log.txt'
-//   ✅ Resume interrupted file transfers using .meta files
+//   ✅ Resume interrupted file transfers using crash-safe .ckpt files
 //   ✅ Full-duplex parallel threads (send + receive)
 // --------------------------------------------------------------
 
@@ -15,11 +15,20 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <errno.h>
 
 #define MAX 1024
+#define WRITE_BUF (1 << 20)             // received data reaches the disk in writes of up to 1 MB
+#define SAVE_EVERY (WRITE_BUF / MAX)    // chunks between progress saves (each one flushes the buffer first)
 #define PORT 8210
 #define FILE_START "FILE_START"
 #define FILE_END   "FILE_END"
+#define RESUME     "RESUME"            // receiver's answer to FILE_START: "RESUME <id> <chunk>"
+#define RESUME_TRIES 5                  // FILE_START is resent this often while no answer comes ...
+#define RESUME_WAIT_MS 500              // ... this long apart
 
 int sockfd;
 struct sockaddr_in servaddr;
@@ -43,32 +52,141 @@ void log_event(const char *fmt, ...) {
     va_end(args);
 }
 
+// --------------------------------------------------------------
+// Resume checkpoint: "<file>.ckpt" holds two checksummed progress
+// records in one mapped page, written alternately, so a crash or a
+// torn write can only damage the record being written
+// --------------------------------------------------------------
+#define CKPT_MAGIC 0x54504b43u // "CKPT"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t gen;        // write generation: the valid record with the highest one wins
+    int64_t chunk;       // chunks completed
+    int64_t bytes;       // length of the file they make up
+    uint64_t sum;        // checksum of the fields above
+} progress_rec_t;
+
+typedef struct {
+    int fd;
+    progress_rec_t *rec; // rec[0], rec[1] in the mapped file (NULL: no checkpoint)
+    uint32_t gen;
+} progress_t;
+
+uint64_t progress_sum(const progress_rec_t *r) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    h = (h ^ r->magic) * 1099511628211ULL;
+    h = (h ^ r->gen) * 1099511628211ULL;
+    h = (h ^ (uint64_t)r->chunk) * 1099511628211ULL;
+    h = (h ^ (uint64_t)r->bytes) * 1099511628211ULL;
+    return h;
+}
+
 // --------------------------------------------------------------
 // Function: get_resume_point
-// Purpose:  Read last saved chunk number from .meta file
-// --------------------------------------------------------------
-long get_resume_point(const char *filename) {
-    char metafile[300];
-    snprintf(metafile, sizeof(metafile), "%s.meta", filename);
-    FILE *meta = fopen(metafile, "r");
-    if (!meta) return 0;
-    long chunk;
-    fscanf(meta, "%ld", &chunk);
-    fclose(meta);
+// Purpose:  Map the checkpoint and return the last saved chunk count
+// --------------------------------------------------------------
+long get_resume_point(progress_t *p, const char *filename, long *bytes) {
+    char ckptfile[300];
+    snprintf(ckptfile, sizeof(ckptfile), "%s.ckpt", filename);
+    p->rec = NULL;
+    p->gen = 0;
+    *bytes = 0;
+    p->fd = open(ckptfile, O_RDWR | O_CREAT, 0644);
+    if (p->fd < 0) return 0;
+    struct stat st;
+    size_t size = 2 * sizeof(progress_rec_t);
+    void *map = MAP_FAILED;
+    if (fstat(p->fd, &st) == 0 && (st.st_size >= (off_t)size || ftruncate(p->fd, size) == 0))
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0);
+    if (map == MAP_FAILED) {
+        close(p->fd);
+        p->fd = -1;
+        return 0;
+    }
+    p->rec = map;
+    long chunk = 0;
+    for (int i = 0; i < 2; i++) {
+        progress_rec_t *r = &p->rec[i];
+        if (r->magic == CKPT_MAGIC && r->sum == progress_sum(r) && r->chunk >= 0 && r->bytes >= 0 && r->gen >= p->gen) {
+            p->gen = r->gen;
+            chunk = r->chunk;
+            *bytes = r->bytes;
+        }
+    }
     return chunk;
 }
 
 // --------------------------------------------------------------
 // Function: save_progress
-// Purpose:  Write the number of chunks processed so far to .meta
-// --------------------------------------------------------------
-void save_progress(const char *filename, long chunk_num) {
-    char metafile[300];
-    snprintf(metafile, sizeof(metafile), "%s.meta", filename);
-    FILE *meta = fopen(metafile, "w");
-    if (!meta) return;
-    fprintf(meta, "%ld", chunk_num);
-    fclose(meta);
+// Purpose:  Record the number of chunks processed so far; with sync
+//           set, the file data (if any) is flushed to disk first and
+//           the record after it
+// --------------------------------------------------------------
+void save_progress(progress_t *p, long chunk_num, long bytes, FILE *data, int sync) {
+    if (!p->rec) return;
+    if (sync && data) {
+        // the record may only vouch for chunks that are on disk
+        fflush(data);
+        fdatasync(fileno(data));
+    }
+    progress_rec_t r = { .magic = CKPT_MAGIC, .gen = ++p->gen, .chunk = chunk_num, .bytes = bytes };
+    r.sum = progress_sum(&r);
+    p->rec[r.gen & 1] = r; // never overwrites the newest record
+    if (sync) msync(p->rec, 2 * sizeof(progress_rec_t), MS_SYNC);
+}
+
+// --------------------------------------------------------------
+// Function: close_progress
+// Purpose:  Unmap the checkpoint
+// --------------------------------------------------------------
+void close_progress(progress_t *p) {
+    if (!p->rec) return;
+    munmap(p->rec, 2 * sizeof(progress_rec_t));
+    close(p->fd);
+    p->rec = NULL;
+    p->fd = -1;
+}
+
+// --------------------------------------------------------------
+// Function: remove_progress
+// Purpose:  Drop the checkpoint of a completed file, so the next
+//           file by that name starts from chunk 0
+// --------------------------------------------------------------
+void remove_progress(progress_t *p, const char *filename) {
+    char ckptfile[300];
+    close_progress(p);
+    snprintf(ckptfile, sizeof(ckptfile), "%s.ckpt", filename);
+    unlink(ckptfile);
+}
+
+// --------------------------------------------------------------
+// Resume handshake: only the receiver knows how much of a file
+// reached its disk, so it answers FILE_START with the resume point.
+// The socket is read by receive_data, which passes answers on.
+// --------------------------------------------------------------
+pthread_mutex_t resume_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t resume_cond = PTHREAD_COND_INITIALIZER;
+unsigned resume_id = 0;   // FILE_START id the latest answer belongs to
+long resume_reply = 0;    // chunk to resume from
+
+// --------------------------------------------------------------
+// Function: wait_resume
+// Purpose:  Wait for the RESUME answer to FILE_START <id>
+//           (-1 if none came in time)
+// --------------------------------------------------------------
+long wait_resume(unsigned id) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += RESUME_WAIT_MS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+    pthread_mutex_lock(&resume_lock);
+    while (resume_id != id && pthread_cond_timedwait(&resume_cond, &resume_lock, &until) != ETIMEDOUT)
+        ;
+    long chunk = resume_id == id ? resume_reply : -1;
+    pthread_mutex_unlock(&resume_lock);
+    return chunk;
 }
 
 // --------------------------------------------------------------
@@ -80,7 +198,9 @@ void *receive_data(void *args) {
     FILE *fp = NULL;
     int receiving_file = 0;
     char filename[256];
-    long chunk_count = 0;
+    long chunk_count = 0, byte_count = 0;
+    progress_t prog = { .fd = -1 };
+    unsigned xfer_id = 0; // id of the FILE_START being received
 
     while (1) {
         bzero(buff, MAX);
@@ -92,14 +212,47 @@ void *receive_data(void *args) {
 
         // ---- When a file transfer starts ----
         if (strncmp(buff, FILE_START, strlen(FILE_START)) == 0) {
-            sscanf(buff + strlen(FILE_START), "%s", filename);
-            long resume_chunk = get_resume_point(filename);
-            fp = fopen(filename, resume_chunk ? "ab" : "wb"); // append if resuming
+            unsigned id = 0;
+            char reply[64];
+            sscanf(buff + strlen(FILE_START), "%255s %u", filename, &id);
+            if (fp && id && id == xfer_id) {
+                // our answer got lost: repeat it
+                snprintf(reply, sizeof(reply), "%s %u %ld", RESUME, id, chunk_count);
+                sendto(sockfd, reply, strlen(reply), 0, (const struct sockaddr *)&servaddr, len);
+                continue;
+            }
+            if (fp) {
+                // a transfer that never saw FILE_END: keep what it got
+                save_progress(&prog, chunk_count, byte_count, fp, 1);
+                fclose(fp);
+                fp = NULL;
+            }
+            close_progress(&prog);
+            long resume_bytes;
+            long resume_chunk = get_resume_point(&prog, filename, &resume_bytes);
+            // continue right after the last checkpointed chunk, dropping whatever
+            // reached the file after it; a file shorter than the checkpoint starts over
+            struct stat st;
+            fp = resume_chunk ? fopen(filename, "r+b") : NULL;
+            if (fp && (fstat(fileno(fp), &st) < 0 || st.st_size < resume_bytes ||
+                       ftruncate(fileno(fp), resume_bytes) < 0 || fseek(fp, resume_bytes, SEEK_SET) < 0)) {
+                fclose(fp);
+                fp = NULL;
+            }
+            if (!fp) {
+                resume_chunk = resume_bytes = 0;
+                fp = fopen(filename, "wb");
+            }
             if (!fp) {
                 perror("File open error");
                 continue;
             }
+            setvbuf(fp, NULL, _IOFBF, WRITE_BUF); // one write() per WRITE_BUF bytes instead of per datagram
             chunk_count = resume_chunk;
+            byte_count = resume_bytes;
+            xfer_id = id;
+            snprintf(reply, sizeof(reply), "%s %u %ld", RESUME, id, chunk_count);
+            sendto(sockfd, reply, strlen(reply), 0, (const struct sockaddr *)&servaddr, len);
             receiving_file = 1;
 
             log_event("Receiving file '%s' (resume from chunk %ld)", filename, resume_chunk);
@@ -107,9 +260,31 @@ void *receive_data(void *args) {
             continue;
         }
 
+        // ---- Answer to our own FILE_START: hand it to the sending thread ----
+        if (strncmp(buff, RESUME, strlen(RESUME)) == 0) {
+            unsigned id;
+            long chunk;
+            if (sscanf(buff + strlen(RESUME), "%u %ld", &id, &chunk) == 2) {
+                pthread_mutex_lock(&resume_lock);
+                resume_id = id;
+                resume_reply = chunk;
+                pthread_cond_broadcast(&resume_cond);
+                pthread_mutex_unlock(&resume_lock);
+            }
+            continue;
+        }
+
         // ---- When file transfer ends ----
         if (strncmp(buff, FILE_END, strlen(FILE_END)) == 0) {
-            if (fp) fclose(fp);
+            if (fp) {
+                // complete: nothing left to resume
+                fflush(fp);
+                fdatasync(fileno(fp));
+                fclose(fp);
+                fp = NULL;
+                remove_progress(&prog, filename);
+            }
+            close_progress(&prog);
             receiving_file = 0;
             log_event("File '%s' received successfully (%ld chunks)", filename, chunk_count);
             printf("\n[CLIENT] File '%s' received successfully (%ld chunks)\n", filename, chunk_count);
@@ -120,7 +295,10 @@ void *receive_data(void *args) {
         if (receiving_file) {
             fwrite(buff, 1, n, fp);
             chunk_count++;
-            save_progress(filename, chunk_count);
+            byte_count += n;
+            // the checkpoint may only count chunks that reached the disk
+            if (chunk_count % SAVE_EVERY == 0)
+                save_progress(&prog, chunk_count, byte_count, fp, 1);
             printf("[CLIENT] Receiving chunk #%ld\r", chunk_count);
             fflush(stdout);
         } else {
@@ -163,24 +341,31 @@ void *send_file(void *args) {
             continue;
         }
 
-        // ---- Check if resuming ----
-        long resume_chunk = get_resume_point(filename);
+        // ---- Notify server of file start; it answers with the chunk to resume from ----
+        unsigned id = (unsigned)time(NULL) ^ (unsigned)getpid() << 16 ^ (unsigned)rand();
+        char header[512];
+        snprintf(header, sizeof(header), "%s %s %u", FILE_START, filename, id);
+        long resume_chunk = -1;
+        for (int t = 0; t < RESUME_TRIES && resume_chunk < 0; t++) {
+            sendto(sockfd, header, strlen(header), 0, (const struct sockaddr *)&servaddr, len);
+            resume_chunk = wait_resume(id);
+        }
+        if (resume_chunk < 0) {
+            // the receiver is not taking this file: its data would only be printed
+            printf("\n[CLIENT] No answer from server, '%s' not sent\n", filename);
+            log_event("No answer to FILE_START for '%s', not sent", filename);
+            fclose(fp);
+            continue;
+        }
         fseek(fp, resume_chunk * MAX, SEEK_SET);
         log_event("Sending file '%s' (resume from chunk %ld)", filename, resume_chunk);
 
-        // ---- Notify server of file start ----
-        char header[512];
-        snprintf(header, sizeof(header), "%s %s", FILE_START, filename);
-        sendto(sockfd, header, strlen(header), 0, (const struct sockaddr *)&servaddr, len);
-        usleep(100000); // slight delay before sending chunks
-
         long chunk_count = resume_chunk;
         while (!feof(fp)) {
             int bytes_read = fread(buff, 1, MAX, fp);
             if (bytes_read > 0) {
                 sendto(sockfd, buff, bytes_read, 0, (const struct sockaddr *)&servaddr, len);
                 chunk_count++;
-                save_progress(filename, chunk_count);
                 printf("[CLIENT] Sent chunk #%ld\r", chunk_count);
                 fflush(stdout);
                 usleep(1000);
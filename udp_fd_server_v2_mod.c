@@ -13,6 +13,7 @@
 #include <pthread.h>
 
 #define MAX 1024
+#define WRITE_BUF (1 << 20) // received data reaches the disk in writes of up to 1 MB
 #define PORT 8210
 #define FILE_START "FILE_START"
 #define FILE_END "FILE_END"
@@ -48,6 +49,7 @@ void *receive_data(void *args)
                 perror("File open error");
                 continue;
             }
+            setvbuf(fp, NULL, _IOFBF, WRITE_BUF); // one write() per WRITE_BUF bytes instead of per datagram
             receiving_file = 1;
             chunk_count = 0;
             printf("\n[SERVER] Receiving file: %s -> saved as %s\n", filename, new_filename);
@@ -22,7 +22,8 @@ struct sockaddr_in cliaddr;
 socklen_t len = sizeof(cliaddr);
 int sockfd;
 
-#define TIMEOUT_USEC 500000 // 0.5s timeout
+#define RTO_INIT_USEC 500000 // initial timeout (0.5s), until the first RTT sample
+#include "udp_rto.h"            // adaptive timeout (RFC 6298), shared with the folder client
 
 // ---------------------- Receiver Thread ----------------------
 void *receive_data(void *args)
@@ -154,41 +155,58 @@ void *send_file(void *args)
             memcpy(packet + strlen(packet), buff, bytes);// Append raw bytes
 
             int ack_received = 0;// Flag for acknowledgment
+            int attempts = 0;// Transmissions of this chunk (Karn's rule)
+            long sent_at;
             while (!ack_received)
             {
             	// Send current packet
+                sent_at = rto_now_usec();
+                attempts++;
                 sendto(sockfd, packet, strlen(packet), 0, (struct sockaddr *)&cliaddr, len);
                 printf("[SERVER] Sent chunk #%d (seq %d)\n", ++chunk_no, seq);
-                
-                // Wait for ACK using select()
-                FD_ZERO(&readfds);//Clears (initializes) the file-descriptor set readfds
-                FD_SET(sockfd, &readfds);//Adds our UDP socket sockfd into the readfds set.
-                tv.tv_sec = 0;
-                tv.tv_usec = TIMEOUT_USEC;//Sets the timeout for select().
-
-                int rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
-                if (rv > 0)
+
+                // Wait out this RTO for the matching ACK: a stale or mismatched one does not end it
+                long waited;
+                while (!ack_received && (waited = rto_now_usec() - sent_at) < rto)
                 {
-                    // ACK received before timeout
+                    FD_ZERO(&readfds);
+                    FD_SET(sockfd, &readfds);
+                    tv.tv_sec = (rto - waited) / 1000000;
+                    tv.tv_usec = (rto - waited) % 1000000;// What is left of the adaptive timeout
+
+                    int rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
+                    if (rv < 0 && errno == EINTR)
+                        continue;
+                    if (rv <= 0)
+                        break;// Timeout
                     char ack[32];
-                    int n = recvfrom(sockfd, ack, sizeof(ack), 0, NULL, NULL);
+                    int n = recvfrom(sockfd, ack, sizeof(ack) - 1, 0, NULL, NULL);
+                    if (n <= 0)
+                        continue;
                     ack[n] = '\0';
                     int ack_seq;
-                    
-                    // Validate ACK sequence number
+
+                    // Validate ACK
                     if (sscanf(ack, "ACK:%d", &ack_seq) == 1 && ack_seq == seq)
                     {
-                        ack_received = 1;
-                        seq = 1 - seq;
+                        ack_received = 1;// ACK matches
+                        if (attempts == 1)// only unambiguous RTTs feed the estimator
+                            rtt_sample(rto_now_usec() - sent_at);
+                        seq = 1 - seq;// Flip sequence for next packet
                     }
                 }
-                else
-                    printf("[SERVER] Timeout → retransmitting seq %d...\n", seq);// Timeout occurred → retransmit
+                if (!ack_received)
+                {
+                    rto_backoff();// Exponential backoff, then resend the same packet
+                    printf("[SERVER] Timeout → retransmitting seq %d (rto %ld us)...\n", seq, rto);
+                }
             }
         }
         fclose(fp);
         sendto(sockfd, FILE_END, strlen(FILE_END), 0, (struct sockaddr *)&cliaddr, len);
         printf("[SERVER] File '%s' sent successfully!\n", filename);
+        printf("[SERVER] RTT srtt=%ldus rttvar=%ldus rto=%ldus samples=%ld retransmissions=%ld\n",
+               srtt, rttvar, rto, rtt_samples, retransmissions);
     }
     return NULL;
 }
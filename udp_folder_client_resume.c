@@ -10,7 +10,10 @@
 #define SERVER_IP   "127.0.0.1"
 #define SERVER_PORT 7610
 #define MAX_DATA    1024
-#define TIMEOUT_SEC 2
+#define TIMEOUT_SEC 2          // initial ACK timeout, until the first RTT sample
+#define RTO_INIT_USEC (TIMEOUT_SEC * 1000000L)
+
+#include "udp_rto.h"           // adaptive ACK timeout (RFC 6298), shared with the v3 programs
 
 struct Packet {
     int seq_num;
@@ -24,6 +27,12 @@ struct Ack {
     char filename[100];
 };
 
+// Wait at most usec for the next datagram on sock
+void set_ack_timeout(int sock, long usec) {
+    struct timeval tv = {usec / 1000000, usec % 1000000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
 // Read last acknowledged sequence number for a file from log
 int get_last_ack(const char *filename) {
     FILE *log = fopen("transfer_log.txt", "r");
@@ -95,16 +104,29 @@ void send_file(int sock, struct sockaddr_in server_addr, socklen_t addr_len, con
         if (packet.size <= 0) break;
 
         int acked = 0;
+        int attempts = 0;            // transmissions of this packet (Karn's rule)
+        long sent_at;
         while (!acked) {
+            sent_at = rto_now_usec();
+            attempts++;
             sendto(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&server_addr, addr_len);
             printf("Sent packet %d (%d bytes) of %s\n", packet.seq_num, packet.size, filename);
 
-            int n = recvfrom(sock, &ack, sizeof(ack), 0, (struct sockaddr *)&server_addr, &addr_len);
-            if (n > 0 && ack.seq_num == packet.seq_num) {
+            // a stale or mismatched ACK does not end the wait: only the RTO running out does
+            long waited;
+            while (!acked && (waited = rto_now_usec() - sent_at) < rto) {
+                set_ack_timeout(sock, rto - waited);
+                int n = recvfrom(sock, &ack, sizeof(ack), 0, (struct sockaddr *)&server_addr, &addr_len);
+                if (n < 0) break;
+                if (ack.seq_num != packet.seq_num) continue;
                 printf("ACK %d received for %s\n", ack.seq_num, filename);
+                if (attempts == 1)
+                    rtt_sample(rto_now_usec() - sent_at);
                 update_log(filename, ack.seq_num);
                 acked = 1;
-            } else {
+            }
+            if (!acked) {
+                rto_backoff();
                 printf("Timeout — resending packet %d of %s\n", packet.seq_num, filename);
             }
         }
@@ -116,6 +138,8 @@ void send_file(int sock, struct sockaddr_in server_addr, socklen_t addr_len, con
     strcpy(packet.filename, filename);
     sendto(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&server_addr, addr_len);
     printf("[+] EOF for file %s sent.\n", filename);
+    printf("[+] RTT srtt=%ldus rttvar=%ldus rto=%ldus samples=%ld retransmissions=%ld\n",
+           srtt, rttvar, rto, rtt_samples, retransmissions);
 
     fclose(fp);
 }
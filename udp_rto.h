@@ -0,0 +1,60 @@
+/*
+ udp_rto.h
+ Adaptive retransmission timeout for the stop-and-wait programs
+ (udp_fd_client_v3_mod.c, udp_fd_server_v3_mod.c, udp_folder_client_resume.c)
+
+ Jacobson/Karels estimator (RFC 6298): RTO = SRTT + 4*RTTVAR, doubled on every
+ timeout and kept within [RTO_MIN_USEC, RTO_MAX_USEC]. Karn's rule is the
+ caller's: a packet that had to be retransmitted gives no RTT sample.
+
+ The including program defines RTO_INIT_USEC, the timeout used until the first
+ sample, and includes this header exactly once, so the single-file compile lines
+ keep working.
+*/
+
+#ifndef UDP_RTO_H
+#define UDP_RTO_H
+
+#include <time.h>
+
+#ifndef RTO_INIT_USEC
+#error "define RTO_INIT_USEC (the timeout before the first RTT sample) before including udp_rto.h"
+#endif
+
+#define RTO_MIN_USEC 2000          // adaptive timeout is kept within [2ms, 4s]
+#define RTO_MAX_USEC 4000000
+
+long srtt = 0, rttvar = 0, rto = RTO_INIT_USEC; // microseconds
+long rtt_samples = 0, retransmissions = 0;
+
+long rto_clamp(long v) {
+    return v < RTO_MIN_USEC ? RTO_MIN_USEC : (v > RTO_MAX_USEC ? RTO_MAX_USEC : v);
+}
+
+void rtt_sample(long rtt) {
+    if (rtt_samples++ == 0) {
+        srtt = rtt;
+        rttvar = rtt / 2;
+    } else {
+        long err = srtt > rtt ? srtt - rtt : rtt - srtt;
+        rttvar = (3 * rttvar + err) / 4;
+        srtt = (7 * srtt + rtt) / 8;
+    }
+    rto = rto_clamp(srtt + 4 * rttvar);
+}
+
+// a timeout: back off before the packet goes out again
+void rto_backoff(void) {
+    rto = rto_clamp(rto * 2);
+    retransmissions++;
+}
+
+// microseconds on CLOCK_MONOTONIC: RTT samples and ACK deadlines must not jump
+// when the wall clock is stepped (NTP, an operator)
+long rto_now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+#endif
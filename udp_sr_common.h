@@ -0,0 +1,4552 @@
+/*
+ udp_sr_common.h
+ Selective Repeat ARQ over UDP - engine shared by udp_sr_server.c and udp_sr_client.c
+
+ Both programs run the same receiver and sender; they only differ in how the
+ peer address is learned (server: from the latest client's hello, client: fixed).
+ Each program includes this header exactly once, so the single-file compile
+ lines keep working:
+   gcc udp_sr_server.c -o udp_sr_server -pthread
+   gcc udp_sr_client.c -o udp_sr_client -pthread
+
+ Window size:
+  - the sender window is set at startup with "-w <packets>" (1..SR_MAX_WINDOW)
+  - FILE_START carries it to the receiver, which sizes its window to match
+  - windows live on the heap as rings of a power-of-two capacity, chunk seq
+    lives in slot seq & mask; per-slot flags (present / sent / acked) are kept
+    in bitmaps that are scanned a 64-bit word at a time
+
+ ACK policy (receiver):
+  - a SACK goes out after every "-a <n>" data packets or "-d <usec>" after the
+    first unacknowledged one, whichever comes first
+  - it goes out at once for out-of-order arrivals, duplicates, while a gap is
+    open, when a gap is filled and for the last chunk (flags bit0)
+
+ Retransmission timeout (sender):
+  - SRTT/RTTVAR per transfer (Jacobson/Karels, RFC 6298) from the ts echoed in SACKs
+  - Karn's rule: no sample from a SACK that newly covers a retransmitted chunk
+  - exponential backoff on timeout, RTO clamped to [SR_RTO_MIN_USEC, SR_RTO_MAX_USEC]
+  - per-packet deadlines on CLOCK_MONOTONIC live in a min-heap; the sender sleeps in
+    ppoll() until the earliest one instead of polling the window
+  - the estimator state is logged and printed when each send completes
+
+ Congestion control (sender):
+  - "-c newreno" (default), "-c cubic" or "-c bbr" picks the controller, an sr_cc_ops_t;
+    it is told of every ACK (packets acked, RTT sample, delivery rate), of the losses
+    SACK frames reveal and of retransmission timeouts
+  - a chunk is presumed lost once a seq SR_DUPTHRESH past it is SACKed; it is then
+    resent at once and the controller cuts cwnd, at most once per window of data
+    (NewReno recovery)
+  - new chunks only go out while the packets in flight (sent, but neither acked nor
+    SACKed) stay below min(cwnd, receiver window); cwnd and ssthresh are logged on
+    every SACK
+  - a controller may also set a pacing rate, and new chunks are then spaced 1/rate
+    apart; the sender sleeps until the next send time the same way it does for timers
+  - "bbr" models the path as its bottleneck bandwidth times its min RTT, both taken from
+    the delivery-rate samples, paces at gain x bandwidth and cycles the gain to probe
+    for more bandwidth
+
+ Batched I/O:
+  - the sender queues each pass's transmissions (new chunks, fast retransmits,
+    timeouts) and hands them to the kernel in one sendmmsg() per "-b <n>" packets;
+    header and payload go out as two iovecs, so the window slot is not copied
+  - the receiver drains up to n datagrams per recvmmsg() and sends the SACKs the
+    batch asked for once it is processed; the sender drains SACKs the same way
+  - average batch fill (packets per call) is logged at the end of each transfer
+  - "-G <segs>" adds UDP GSO: runs of full-size packets leave as one UDP_SEGMENT
+    message of up to segs datagrams (as many as fit in 64 KB), and UDP_GRO lets the
+    receiver take coalesced datagrams, which are split back into packets before processing
+
+ Path MTU / chunk size (sender):
+  - each transfer picks its chunk when it opens: the path MTU the kernel knows for the
+    peer (IP_MTU of a socket connected to it) minus the IP, UDP and packet headers, so
+    every data packet is one unfragmented datagram (65488 bytes on loopback, 1453 on
+    Ethernet); CHUNK_SIZE only if the MTU cannot be read, "-C <bytes>" caps it, and
+    window x chunk stays within SR_MAX_WINDOW_BYTES
+  - data sockets send with DF set (IP_PMTUDISC_DO), and FILE_START, which carries the
+    chunk to the receiver, is padded to a full data packet: it is the probe. Before each
+    resend the chunk shrinks to whatever the kernel has learnt since (ICMP "fragmentation
+    needed"), at once if the send failed with EMSGSIZE, and to CHUNK_SIZE once half the
+    tries went unanswered (a black hole that drops the ICMP answers)
+  - a transfer cannot change its chunk once sending: if EMSGSIZE shows the path MTU
+    dropping later, DF is cleared and the rest of it goes out fragmented; the next
+    transfer starts with DF set and probes again
+  - the receiver sizes its window slots, write offsets and checkpoint by the chunk of
+    each FILE_START, and asks for SR_SOCK_RCVBUF of socket buffer for large datagrams
+
+ io_uring backend ("-u"):
+  - each thread drives its own ring (raw syscalls, no liburing): socket receives are
+    always-posted RECVMSG SQEs, sends are SENDMSG SQEs, the sender's chunk reads and
+    the receiver's chunk writes are READ/WRITE SQEs at chunk offsets, and waits use
+    IORING_OP_TIMEOUT; disk and network work overlap in the same thread
+  - falls back to the plain syscalls if the kernel has no (usable) io_uring
+
+ Zero-copy sender ("-m"):
+  - the file is mmap'd read-only (MADV_SEQUENTIAL) and each window slot points into
+    the mapping, so a chunk is never read into a buffer: its pages go straight into
+    the header + payload iovec pair, retransmissions included, and the window holds
+    no payload memory at all
+  - the file must not shrink while it is being sent; if it cannot be mapped the
+    sender falls back to reading chunks into a per-window buffer
+
+ MSG_ZEROCOPY ("-z", sender):
+  - data packets are sent with MSG_ZEROCOPY on an SO_ZEROCOPY socket: the kernel pins
+    the header and payload pages instead of copying them and reports when it is done
+    through the socket error queue, one id per send call
+  - each window slot remembers the last send that references it; its buffer (and its
+    header, which is referenced in place too) is only rewritten once that id completed
+  - the kernel falls back to copying where it cannot avoid it (loopback always
+    copies); such completions are counted and logged next to the send count
+  - every transfer logs the sending thread's CPU time per GB, so -z (and -m, and
+    chunk sizes capped with -C) can be compared on the real path
+  - not combined with -u: io_uring sends keep copying
+
+ Direct writes ("-p", receiver):
+  - FILE_START's total_chunks preallocates the output file (posix_fallocate), and every
+    chunk is pwrite()n at seq * chunk the moment it arrives, in or out of order
+  - the window keeps no payload, only its received-chunk bitmap, so even a window of
+    SR_MAX_WINDOW packets costs a few KB; the file is trimmed to its exact size (FILE_START's
+    byte count, else known from the last chunk) at FILE_END
+  - the writes are plain pwrite() calls with -u as well: the ring's receive buffers are
+    reposted right after each batch, so they cannot be the source of a deferred write
+
+ Coalesced writes (receiver):
+  - delivered chunks stay in the window until "-W <bytes>" of them (default 1 MB) can
+    go to disk in one pwritev(); the window ring has room for them on top of the
+    sender's window, and slot payloads are one contiguous buffer, so a run needs at
+    most two iovecs (two WRITE SQEs with -u) however many chunks it holds
+  - the resume checkpoint only ever counts chunks that were handed to the kernel
+  - "-S" follows each synchronous write with sync_file_range(SYNC_FILE_RANGE_WRITE),
+    so dirty pages stream out instead of piling up until the kernel flushes them
+
+ Resume checkpoints:
+  - the receiver keeps a memory-mapped checkpoint next to each file ("<received file>.ckpt"):
+    two checksummed header slots (generation, total chunks, chunk size, file size and
+    mtime, resume base, bitmap checksum, a copy of the bits just past the base) and one
+    bit per chunk written to disk; a FILE_START for a file of another size or mtime
+    (FILE_START carries both) starts over
+  - marking a chunk is a bit set in the mapping; the checkpoint is made durable every
+    "-k <chunks>" (default SR_CKPT_EVERY) and/or "-K <ms>", and when the transfer ends:
+    file data first (fdatasync), then the bitmap, then the header into the slot not
+    holding the last good one
+  - on restart the valid header with the highest generation wins; if the bitmap no
+    longer matches its checksum (a crash between flushes, or a torn write) only the
+    chunks below that header's base and those in its copy are trusted
+  - a transfer whose every chunk was delivered deletes its checkpoint, so the next file
+    by that name is sent in full
+
+ Resume handshake:
+  - only the receiver knows what reached its disk, so it decides where a transfer resumes:
+    FILE_START carries a transfer id, and the receiver answers it with a RESUME frame
+    (its checkpointed base, plus with -p the chunks past it already written)
+  - the sender starts at that base and counts the listed chunks as acked without ever
+    sending them; FILE_START is resent until an answer with its id arrives
+    (SR_START_TRIES times, SR_START_WAIT_USEC apart, after which the transfer fails),
+    a repeated FILE_START is answered again without resetting anything
+
+ Sessions:
+  - a client picks a random session id (sid) at startup and announces it in its hello;
+    every datagram (data, SACK/RESUME frames, text messages) starts with it
+  - the receiver keeps one session per sid and stream (file, window, checkpoint, pending
+    SACK) in an open-addressing hash table, so one server takes transfers from many clients
+    at once; replies go to the address the session's latest datagram came from
+  - a FILE_START opens the session (at most SR_MAX_SESSIONS, later ones are refused and
+    logged); a session silent for -I seconds (default SR_SESSION_IDLE) is evicted, its
+    checkpoint flushed first so the client can resume where it left off
+  - the sender ignores SACK/RESUME frames for any sid but its own
+
+ Workers (server, -N <n>):
+  - n receiver threads, each with its own SO_REUSEPORT socket bound to the port and its
+    own session table; nothing on the packet path is shared between them
+  - by default the kernel spreads clients over the sockets by address hash; with -R a
+    reuseport cBPF program picks socket sid % n instead, so a session stays on its
+    worker even if the client's address changes
+  - the server's own sender talks to the latest client through the socket its hello came in on
+
+ Dispatcher (threaded mode):
+  - the receiver and sender threads never read their socket themselves: a dispatcher thread
+    per socket drains it in batches and sorts each datagram, SACK/RESUME frames to the
+    sender and data/text to the receiver, through two lock-free single-producer
+    single-consumer rings; a consumer sleeps on the ring's eventfd only when it is empty
+  - so a transfer in each direction at once no longer loses packets to the wrong thread
+  - with -u only the dispatcher's socket receives use io_uring; the receiver's writes and
+    the sender's reads and sends are plain syscalls, as in the reactor
+
+ Streams (-M <n>):
+  - every file named on one input line goes out at once, up to n (default SR_STREAMS)
+    of them, each as a stream of the session: the stream id is in every data packet,
+    SACK/RESUME frame and FILE_START/FILE_END, and the receiver keeps a session per
+    (sid, stream), so each has its own seq space, window, timers and checkpoint
+  - the streams share one path state (sr_link_t): cwnd, delivery rate and pacing; a
+    loss seen by several streams within one round trip cuts cwnd once
+  - each send pass splits the room cwnd leaves into equal shares, round robin, so a
+    small file finishes in its own few round trips next to a large one
+
+ Striping (-P <n>, client):
+  - one flow (5-tuple) is hashed to one receive queue and one reuseport worker, so one
+    core receives all of it; -P opens n - 1 more sockets to the server, each a session
+    of its own (sid + k), and cuts every file into n contiguous chunk ranges
+  - stripe k is an ordinary transfer of its range over socket k, from a sender thread of
+    its own with its own cwnd; FILE_START carries the range's byte offsets (ranges are
+    cut in CHUNK_SIZE units, so they tile the file whatever chunk each stripe probes)
+  - at the server each stripe is a session on whichever worker its flow lands on (with
+    -R on worker (sid + k) % N): it writes its range into the shared output file at its
+    offsets and journals it in "<received file>.<origin>-<end>.ckpt"; stripes share no
+    state at either end, so nothing on the packet path is locked
+
+ Forward error correction ("-F <n>", sender):
+  - every group of n chunks (seqs g*n .. g*n + n - 1) is followed by k parity packets, a
+    systematic Reed-Solomon code over GF(256): parity 0 is the XOR of the group, and any
+    e <= k chunks lost from a group are rebuilt from any e of its parity packets, with
+    no retransmission and no round trip. FILE_START carries n to the receiver
+  - k adapts per group to the loss rate the receiver sees (seqs skipped by each new
+    highest seq, over the last few thousand), which every SACK frame carries: expected
+    losses per group plus one standard deviation, 1..SR_FEC_MAX_PARITY
+  - a hole is only presumed lost once SR_DUPTHRESH seqs past its group (and so past its
+    parity) are SACKed; a repaired loss never reaches the congestion controller
+  - GF(256) products are two 16-entry table lookups per byte, 32 or 16 bytes at a
+    time with PSHUFB (AVX2, SSSE3) when the CPU has it
+
+ Reactor (-E):
+  - instead of a receiver and a sender thread, one thread runs every state machine:
+    the socket receivers (sessions) and the operator's transfers, which run as
+    streams exactly as from the sender thread
+  - it sleeps in epoll_wait on the sockets, stdin and one timerfd armed for the
+    earliest deadline (held-back SACK, sweep, FILE_START resend, RTO, paced send):
+    no polling, and an idle program uses no CPU
+  - as the only reader of its sockets it hands SACK/RESUME frames to the transfer and
+    everything else to the receivers; it does not use the io_uring backend
+*/
+
+#ifndef UDP_SR_COMMON_H
+#define UDP_SR_COMMON_H
+
+#define _GNU_SOURCE                // ppoll(), sendmmsg(), recvmmsg()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/udp.h>           // UDP_SEGMENT, UDP_GRO
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <fcntl.h>                 // posix_fallocate, sync_file_range
+#include <sys/syscall.h>
+#include <linux/io_uring.h>        // -u backend: raw io_uring_setup/io_uring_enter, no liburing needed
+#include <linux/errqueue.h>        // MSG_ZEROCOPY completions
+#include <sys/resource.h>
+#include <sys/epoll.h>           // -E reactor: epoll_wait, timerfd deadlines
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>         // dispatcher queue wakeups
+#include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>             // -F: PSHUFB GF(256) products (AVX2 / SSSE3, picked at run time)
+#endif
+
+#ifndef CHUNK_SIZE                 // may be overridden at build time (-DCHUNK_SIZE=n) to compare chunk sizes
+#define CHUNK_SIZE 1024            // payload bytes per data packet when the path MTU is unknown (see Path MTU)
+#endif
+#define SR_MIN_CHUNK 512           // smallest chunk a probed path MTU may lead to
+#define SR_MAX_CHUNK (65507 - HDR_LEN) // largest: one full-size UDP datagram
+#define SR_MAX_WINDOW_BYTES (64L << 20) // window x chunk at most (64 MB: SR_MAX_WINDOW chunks of 1 KB)
+#define MAX_PKT 65536              // any datagram, a data packet of the largest chunk included
+#define SR_DEFAULT_WINDOW 256      // selective repeat window size when -w is not given
+#define SR_MAX_WINDOW 65536        // largest window accepted from -w or FILE_START
+#define TIMEOUT_USEC 500000        // initial retransmission timeout, until the first RTT sample (microseconds)
+#define SR_RTO_MIN_USEC 5000       // RTO floor: covers the receiver's ACK delay plus scheduling noise
+#define SR_RTO_MAX_USEC 4000000    // RTO ceiling, also caps the exponential backoff
+#define SR_ACK_EVERY 4             // default: SACK after this many in-order packets ...
+#define SR_ACK_DELAY_USEC 1000     // ... or this long after the first unacked one
+#define SR_INIT_CWND 10            // congestion window at the start of each transfer (packets)
+#define SR_DUPTHRESH 3             // SACKs this far past a hole mark it lost (fast retransmit)
+#define SR_BATCH 32                // default datagrams per sendmmsg/recvmmsg call
+#define SR_MAX_BATCH 1024          // largest batch accepted from -b
+#define SR_GSO_MAX_SEGS 63         // packets per GSO send at most (fewer as chunks grow: 64 KB per send)
+#define SR_WRITE_COALESCE (1 << 20) // default: receiver writes delivered chunks in runs of up to 1 MB
+#define SR_MAX_COALESCE (64 << 20)  // largest run accepted from -W
+#define SR_MAX_SESSIONS 1024       // sessions one receiver thread serves at once (power of two)
+#define SR_SESSION_IDLE 60         // default: a session silent this many seconds is evicted
+#define SR_SESSION_SWEEP_USEC 1000000 // idle sessions are looked for this often
+#define SR_CKPT_EVERY 1024         // default: checkpoint after this many newly completed chunks ...
+#define SR_CKPT_MS 0               // ... and/or this many ms after the last checkpoint (0 = off)
+#define SR_ZC_IDS 4096             // MSG_ZEROCOPY sends awaiting completion at most (power of two)
+#define SR_GRO_BUF 65536           // receive buffer for a GRO-coalesced datagram
+#define SR_PACE_SLACK_USEC 200     // paced sends may catch up this far behind schedule in one burst
+#define SR_MAX_WORKERS 64          // server receiver threads / reuseport sockets at most (-N)
+#define SR_STREAMS 8               // default: files one session sends at once (streams sharing its cwnd)
+#define SR_MAX_STREAMS 64          // largest value accepted from -M
+#define SR_MAX_STRIPES 16          // sockets one file is striped over at most (-P)
+#define SR_DISPATCH_QUEUE 4096     // datagrams a dispatcher holds for its receiver thread (power of two) ...
+#define SR_DISPATCH_BYTES (8 << 20) // ... in this many bytes
+#define SR_DISPATCH_ACKS 1024      // SACK/RESUME frames it holds for the sender thread ...
+#define SR_DISPATCH_ACK_BYTES (1 << 20) // ... in this many bytes
+#define SR_SOCK_RCVBUF (4 << 20)   // socket receive buffer asked for (a few dozen datagrams of the largest chunk)
+#define SR_FEC_MAX_GROUP 64        // largest FEC group accepted from -F (chunks per parity group)
+#define SR_FEC_MAX_PARITY 8        // parity packets per group at most
+#define SR_FEC_GROUPS 32           // groups a receiver keeps parity for while they miss chunks
+#define SR_FEC_LOSS_SPAN 4096      // the receiver's loss estimate covers about this many seqs
+#define FILE_START_MSG "FILE_START"// text header before file start: "FILE_START <filename> <total_chunks> <window> <bytes> <id> <stream> <origin> <end> <chunk> <fec> <mtime>"
+#define FILE_END_MSG "FILE_END"    // "FILE_END <stream>"
+#define HELLO_MSG "Hello"          // client's first datagram: "Hello from client"
+
+// Every datagram starts with the sender's session id (4 bytes network order), text
+// messages included, so a reuseport program can steer any of them by one load.
+#define SID_LEN 4
+
+// ---------- Packet header layout (we send header bytes then data) ----------
+// Header (19 bytes): [sid (4 bytes network)] [stream (2 bytes network)] [seq (4 bytes network)]
+//                   [len (4 bytes network)] [flags (1 byte)] [ts (4 bytes network)]
+// sid: session the packet belongs to (see Sessions)
+// stream: file of the session it belongs to; each stream has its own seq space (see Streams)
+// Flags: bit0 = 1 -> last chunk (end)
+//        bit1 = 1 -> parity packet (-F): seq is its group's first chunk, bits 2..7 the parity index
+// ts: sender's send time in microseconds (sr_ts_usec), echoed back in SACK frames
+#define HDR_LEN 19
+#define SR_FLAG_PARITY 2
+
+// ---------- SACK frame (receiver -> sender, replaces "ACK:<seq>" text) ----------
+// [ sid (4 net) ] [ "SACK" (4) ] [ stream (2 net) ] [ cum_ack (4 net) ] [ ts_echo (4 net) ] [ nbits (2 net) ]
+// [ loss (2 net) ] [ bitmap (ceil(nbits/8)) ]
+//   sid     : session of the data packets it acknowledges
+//   stream  : and their stream
+//   cum_ack : every seq < cum_ack has been delivered (the receiver's base)
+//   bitmap  : bit i (byte i/8, bit i%8) set -> seq cum_ack + 1 + i is held out of order
+//   ts_echo : ts field of the data packet that triggered this ACK
+//   loss    : share of the stream's packets the receiver saw lost lately, in 1/10000 (sizes FEC parity)
+// One frame confirms the whole window; nbits is trimmed to the highest held seq.
+#define SACK_MAGIC "SACK"
+#define SACK_HDR_LEN 22
+#define SACK_MAX_BITS 8192         // bitmap covers at most this many seqs past cum_ack (1 KB)
+
+// ---------- RESUME frame (receiver -> sender, answers FILE_START) ----------
+// Same layout as a SACK frame, with "RSUM" as magic and the transfer id of the
+// FILE_START it answers in place of ts_echo:
+//   cum_ack : the receiver already has every chunk below it on disk; sending starts here
+//   bitmap  : chunks past it that are on disk as well (-p receivers only), never sent
+#define RESUME_MAGIC "RSUM"
+#define SR_START_TRIES 10          // FILE_START is resent this often while no RESUME answers it ...
+#define SR_START_WAIT_USEC 200000  // ... this long apart; then the transfer fails
+
+int sockfd;
+FILE *log_fp = NULL;
+long sr_window = SR_DEFAULT_WINDOW; // sender window in packets (-w)
+long sr_ack_every = SR_ACK_EVERY;   // receiver coalesces up to this many packets per SACK (-a)
+long sr_ack_delay_usec = SR_ACK_DELAY_USEC; // longest a SACK is held back (-d)
+const char *sr_cc_name = "newreno"; // congestion controller (-c), resolved in sr_parse_args
+int sr_batch = SR_BATCH;            // datagrams per sendmmsg/recvmmsg (-b)
+int sr_gso_segs = 0;                // packets per GSO send, 0 = no UDP GSO/GRO (-G)
+int sr_use_uring = 0;               // io_uring backend (-u)
+int sr_use_mmap = 0;                // sender sends straight from an mmap of the file (-m)
+int sr_use_zerocopy = 0;            // MSG_ZEROCOPY sends (-z)
+int sr_direct_write = 0;            // receiver pwrite()s each chunk at its offset on arrival (-p)
+long sr_write_coalesce = SR_WRITE_COALESCE; // receiver gathers delivered chunks into writes of up to this many bytes (-W)
+int sr_sync_writes = 0;             // receiver starts writeback of every flushed range (-S)
+long sr_ckpt_every = SR_CKPT_EVERY; // checkpoint flush policy: every N chunks (-k, 0 = off) ...
+long sr_ckpt_ms = SR_CKPT_MS;       // ... every T ms (-K, 0 = off); always on close
+long sr_session_idle = SR_SESSION_IDLE; // receiver evicts sessions silent this many seconds (-I)
+int sr_workers = 1;                 // server receiver threads, one reuseport socket each (-N)
+int sr_steer_sid = 0;               // server steers packets to workers by session id (-R)
+int sr_reactor = 0;                 // one epoll thread drives every transfer (-E)
+int sr_streams = SR_STREAMS;        // files sent at once, one stream each (-M)
+int sr_stripes = 1;                 // client sockets each file is striped over (-P)
+long sr_chunk_max = SR_MAX_CHUNK;   // largest chunk the path MTU may lead to (-C)
+int sr_fec_group = 0;               // chunks per FEC parity group, 0 = no parity (-F)
+
+// Who we talk to. The server's sender follows the latest client: a hello received
+// through a peer with learn set moves addr, sid and fd of *learn to it; the
+// client's peer is fixed.
+typedef struct sr_peer {
+    const char *tag;             // "SERVER" / "CLIENT", prefix for console and log lines
+    struct sockaddr_in addr;
+    socklen_t len;
+    struct sr_peer *learn;
+    uint32_t sid;                // session our packets to it carry (client: picked at startup, server: learned)
+    int fd;                      // socket it is reached through
+    struct sr_peer *stripes;     // -P: the same peer through further sockets (sessions sid + 1 ...) ...
+    int nstripes;                // ... this many
+} sr_peer_t;
+
+// ---------- Logging utility ----------
+void log_event(const char *fmt, ...) {
+    if (!log_fp) return;
+    // one write() per line on the O_APPEND descriptor: no stdio lock shared by the
+    // threads, and lines from different threads never interleave
+    char line[1024], ts[32];
+    time_t now = time(NULL);
+    ctime_r(&now, ts);
+    ts[strcspn(ts, "\n")] = '\0';
+    int n = snprintf(line, sizeof(line), "[%s] ", ts);
+    va_list ap;
+    va_start(ap, fmt);
+    n += vsnprintf(line + n, sizeof(line) - n, fmt, ap);
+    va_end(ap);
+    if (n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+    line[n++] = '\n';
+    if (write(fileno(log_fp), line, n) < 0) return;
+}
+
+// ---------- Command line ----------
+const struct sr_cc_ops *sr_cc_find(const char *name); // congestion controllers, defined below
+// -w <packets> : sender window (rounded up to a power of two internally)
+// -a <packets> : receiver sends a SACK at least every this many data packets (1 = ACK every packet)
+// -d <usec>    : receiver holds a SACK back at most this long
+// -c <name>    : sender congestion control, "newreno", "cubic" or "bbr" (paced)
+// -b <n>       : datagrams per sendmmsg/recvmmsg call (1 = one syscall per packet)
+// -G <segs>    : UDP GSO with up to segs packets per send, and UDP GRO on receive
+// -u           : io_uring backend for socket and file I/O
+// -m           : sender maps the file and sends payload straight from the mapping
+// -z           : sender uses MSG_ZEROCOPY (pages are pinned instead of copied into the kernel)
+// -p           : receiver writes each chunk to its place in the file as soon as it arrives
+// -W <bytes>   : receiver holds delivered chunks back until this many can go out in one write
+// -S           : receiver calls sync_file_range() on every written range (streams dirty pages out)
+// -k <chunks>  : flush the resume checkpoint every this many completed chunks (0: only on close)
+// -K <ms>      : flush the resume checkpoint at least this often while chunks complete (0: off)
+// -I <seconds> : receiver evicts a session that has been silent this long
+// -N <n>       : (server) n receiver threads on n SO_REUSEPORT sockets
+// -R           : (server) steer packets to workers by session id instead of address hash
+// -E           : run both directions on one thread (epoll + timerfd reactor) instead of a thread each
+// -M <n>       : send up to n files at once, one stream each
+// -P <n>       : (client) stripe every file over n sockets, one flow each
+// -C <bytes>   : sender never uses chunks larger than this, whatever the path MTU allows
+// -F <n>       : sender follows every n chunks with parity packets the receiver rebuilds losses from
+void sr_parse_args(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "w:a:d:c:b:G:umzpW:Sk:K:I:N:REM:P:C:F:")) != -1) {
+        switch (opt) {
+        case 'w':
+            sr_window = atol(optarg);
+            if (sr_window < 1 || sr_window > SR_MAX_WINDOW) {
+                fprintf(stderr, "window must be 1..%d\n", SR_MAX_WINDOW);
+                exit(1);
+            }
+            break;
+        case 'a':
+            sr_ack_every = atol(optarg);
+            if (sr_ack_every < 1) sr_ack_every = 1;
+            break;
+        case 'd':
+            sr_ack_delay_usec = atol(optarg);
+            if (sr_ack_delay_usec < 0) sr_ack_delay_usec = 0;
+            break;
+        case 'c':
+            sr_cc_name = optarg;
+            if (!sr_cc_find(sr_cc_name)) {
+                fprintf(stderr, "unknown congestion control '%s' (newreno, cubic, bbr)\n", sr_cc_name);
+                exit(1);
+            }
+            break;
+        case 'b':
+            sr_batch = atoi(optarg);
+            if (sr_batch < 1 || sr_batch > SR_MAX_BATCH) {
+                fprintf(stderr, "batch must be 1..%d\n", SR_MAX_BATCH);
+                exit(1);
+            }
+            break;
+        case 'u':
+            sr_use_uring = 1;
+            break;
+        case 'm':
+            sr_use_mmap = 1;
+            break;
+        case 'z':
+            sr_use_zerocopy = 1;
+            break;
+        case 'p':
+            sr_direct_write = 1;
+            break;
+        case 'W':
+            sr_write_coalesce = atol(optarg);
+            // at least the largest chunk a sender's path MTU may pick
+            if (sr_write_coalesce < SR_MAX_CHUNK || sr_write_coalesce > SR_MAX_COALESCE) {
+                fprintf(stderr, "write size must be %d..%d bytes\n", SR_MAX_CHUNK, SR_MAX_COALESCE);
+                exit(1);
+            }
+            break;
+        case 'S':
+            sr_sync_writes = 1;
+            break;
+        case 'k':
+            sr_ckpt_every = atol(optarg);
+            if (sr_ckpt_every < 0) sr_ckpt_every = 0;
+            break;
+        case 'K':
+            sr_ckpt_ms = atol(optarg);
+            if (sr_ckpt_ms < 0) sr_ckpt_ms = 0;
+            break;
+        case 'I':
+            sr_session_idle = atol(optarg);
+            if (sr_session_idle < 1) sr_session_idle = 1;
+            break;
+        case 'N':
+            sr_workers = atoi(optarg);
+            if (sr_workers < 1 || sr_workers > SR_MAX_WORKERS) {
+                fprintf(stderr, "workers must be 1..%d\n", SR_MAX_WORKERS);
+                exit(1);
+            }
+            break;
+        case 'R':
+            sr_steer_sid = 1;
+            break;
+        case 'E':
+            sr_reactor = 1;
+            break;
+        case 'M':
+            sr_streams = atoi(optarg);
+            if (sr_streams < 1 || sr_streams > SR_MAX_STREAMS) {
+                fprintf(stderr, "streams must be 1..%d\n", SR_MAX_STREAMS);
+                exit(1);
+            }
+            break;
+        case 'P':
+            sr_stripes = atoi(optarg);
+            if (sr_stripes < 1 || sr_stripes > SR_MAX_STRIPES) {
+                fprintf(stderr, "stripes must be 1..%d\n", SR_MAX_STRIPES);
+                exit(1);
+            }
+            break;
+        case 'C':
+            sr_chunk_max = atol(optarg);
+            if (sr_chunk_max < SR_MIN_CHUNK || sr_chunk_max > SR_MAX_CHUNK) {
+                fprintf(stderr, "chunk size must be %d..%d bytes\n", SR_MIN_CHUNK, SR_MAX_CHUNK);
+                exit(1);
+            }
+            break;
+        case 'F':
+            sr_fec_group = atoi(optarg);
+            if (sr_fec_group < 0 || sr_fec_group > SR_FEC_MAX_GROUP) {
+                fprintf(stderr, "FEC group must be 0..%d chunks\n", SR_FEC_MAX_GROUP);
+                exit(1);
+            }
+            break;
+        case 'G':
+            sr_gso_segs = atoi(optarg);
+            if (sr_gso_segs < 0 || sr_gso_segs > SR_GSO_MAX_SEGS) {
+                fprintf(stderr, "GSO segments must be 0..%d\n", SR_GSO_MAX_SEGS);
+                exit(1);
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-w window_packets] [-a ack_every] [-d ack_delay_usec] [-c newreno|cubic|bbr] [-b batch] [-G gso_segs] [-u] [-m] [-z] [-p] [-W write_bytes] [-S] [-k ckpt_chunks] [-K ckpt_ms] [-I idle_sec] [-N workers] [-R] [-E] [-M streams] [-P stripes] [-C chunk_bytes] [-F fec_group]\n", argv[0]);
+            exit(1);
+        }
+    }
+}
+
+// ---------- Clock and waiting ----------
+// microseconds on CLOCK_MONOTONIC (immune to wall-clock steps)
+uint64_t sr_now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// the same clock truncated to 32 bits, as carried in packet timestamps (compare with unsigned subtraction)
+uint32_t sr_ts_usec(void) {
+    return (uint32_t)sr_now_usec();
+}
+
+// Block until fd is readable or timeout_usec passes (< 0: no timeout).
+// Returns >0 readable, 0 timed out, <0 error. A wakeup for the error queue alone
+// (MSG_ZEROCOPY completions, -z) returns 0 as well: there is nothing to recv().
+int sr_wait_readable(int fd, int64_t timeout_usec) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct timespec ts = { timeout_usec / 1000000, (timeout_usec % 1000000) * 1000 };
+    int r = ppoll(&pfd, 1, timeout_usec < 0 ? NULL : &ts, NULL);
+    return r > 0 ? (pfd.revents & POLLIN) != 0 : r;
+}
+
+// ---------- Resume checkpoint journal ----------
+// File layout: page 0 holds two sr_ckpt_hdr_t slots, the chunk bitmap starts at
+// SR_CKPT_BITS_OFF (page aligned, so the header page is synced on its own).
+#define SR_CKPT_MAGIC "SRCKPT3"
+#define SR_CKPT_BITS_OFF 4096
+#define SR_CKPT_TAIL_BITS SACK_MAX_BITS // chunks past base each header keeps a copy of (what RESUME can report)
+
+typedef struct {
+    char magic[8];
+    uint64_t gen;                // flush generation: the valid slot with the highest one wins
+    uint64_t total_chunks;
+    uint64_t base;               // every chunk below is done
+    uint64_t bits_sum;           // sr_sum64 of the bitmap as of this flush
+    uint32_t chunk_size;
+    uint32_t pad;
+    int64_t bytes;               // the whole file's length (-1: the sender did not say)
+    int64_t mtime;               // and its modification time at the sender, in ns (0: not said)
+    uint8_t tail[SR_CKPT_TAIL_BITS / 8]; // bit i -> chunk base + 1 + i done, as of this flush
+    uint64_t sum;                // sr_sum64 of the fields above
+} sr_ckpt_hdr_t;
+
+typedef struct {
+    int fd;
+    char *map;                   // NULL: no checkpoint (open failed), transfers still run
+    size_t map_len;
+    sr_ckpt_hdr_t *hdr;          // the two slots
+    uint64_t *bits;              // one bit per chunk
+    long total;
+    int chunk;                   // bytes per chunk of the transfer (recorded in every header)
+    long bytes;                  // file length and mtime, likewise
+    int64_t mtime;
+    char path[640];              // removed once the transfer is complete
+    long base;                   // first chunk not done
+    uint64_t gen;
+    long dirty;                  // chunks marked since the last flush
+    uint64_t flushed_at;         // sr_now_usec of the last flush
+    long flushes;
+} sr_ckpt_t;
+
+// FNV-1a over 64-bit words (n is a multiple of 8)
+uint64_t sr_sum64(const void *p, size_t n) {
+    const uint64_t *w = p;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n / 8; i++) {
+        h ^= w[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+size_t sr_ckpt_bits_len(long total) {
+    return ((total + 63) / 64) * sizeof(uint64_t);
+}
+
+int sr_ckpt_valid(const sr_ckpt_hdr_t *h, long total, int chunk, long bytes, int64_t mtime) {
+    return !memcmp(h->magic, SR_CKPT_MAGIC, sizeof(h->magic)) && h->sum == sr_sum64(h, offsetof(sr_ckpt_hdr_t, sum)) &&
+           h->total_chunks == (uint64_t)total && h->chunk_size == (uint32_t)chunk && h->bytes == bytes &&
+           h->mtime == mtime && h->base <= (uint64_t)total;
+}
+
+// Map (creating it if needed) the checkpoint at path for a transfer of total chunks
+// of `chunk` bytes, of a file `bytes` long last modified at mtime, and recover its
+// state. Returns the resume point: every chunk below it is done (a checkpoint kept at
+// another chunk size, or for a file of another length or mtime, counts for nothing).
+long sr_ckpt_open(sr_ckpt_t *c, const char *path, long total, int chunk, long bytes, int64_t mtime,
+                  const sr_peer_t *peer) {
+    memset(c, 0, sizeof(*c));
+    c->total = total;
+    c->chunk = chunk;
+    c->bytes = bytes;
+    c->mtime = mtime;
+    snprintf(c->path, sizeof(c->path), "%s", path);
+    c->flushed_at = sr_now_usec();
+    c->map_len = SR_CKPT_BITS_OFF + sr_ckpt_bits_len(total);
+    c->fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (c->fd < 0 || fstat(c->fd, &st) < 0) {
+        log_event("%s checkpoint '%s' unavailable (%s), no resume point will be kept", peer->tag, path, strerror(errno));
+        if (c->fd >= 0) close(c->fd);
+        c->fd = -1;
+        return 0;
+    }
+    int reuse = st.st_size == (off_t)c->map_len; // another size: another file (or garbage), start over
+    if ((!reuse && ftruncate(c->fd, 0) < 0) || ftruncate(c->fd, c->map_len) < 0 ||
+        (c->map = mmap(NULL, c->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0)) == MAP_FAILED) {
+        log_event("%s checkpoint '%s' unavailable (%s), no resume point will be kept", peer->tag, path, strerror(errno));
+        close(c->fd);
+        c->fd = -1;
+        c->map = NULL;
+        return 0;
+    }
+    c->hdr = (sr_ckpt_hdr_t *)c->map;
+    c->bits = (uint64_t *)(c->map + SR_CKPT_BITS_OFF);
+    const sr_ckpt_hdr_t *h = NULL;
+    for (int i = 0; reuse && i < 2; i++)
+        if (sr_ckpt_valid(&c->hdr[i], total, chunk, bytes, mtime) && (!h || c->hdr[i].gen > h->gen)) h = &c->hdr[i];
+    if (!h) {
+        memset(c->map, 0, c->map_len);
+        return 0;
+    }
+    c->gen = h->gen;
+    c->base = h->base;
+    if (sr_sum64(c->bits, sr_ckpt_bits_len(total)) != h->bits_sum) {
+        // bitmap pages written back after that flush, or torn: rebuild what the header vouches for
+        log_event("%s checkpoint '%s': bitmap does not match generation %llu, keeping chunks below %ld and its copy past them",
+                  peer->tag, path, (unsigned long long)c->gen, c->base);
+        size_t full = c->base / 64;
+        memset(c->bits, 0xff, full * sizeof(uint64_t));
+        memset(c->bits + full, 0, sr_ckpt_bits_len(total) - full * sizeof(uint64_t));
+        if (c->base % 64) c->bits[full] = (1ULL << (c->base % 64)) - 1;
+        for (long i = 0; i < SR_CKPT_TAIL_BITS && c->base + 1 + i < total; i++)
+            if (h->tail[i >> 3] >> (i & 7) & 1) c->bits[(c->base + 1 + i) >> 6] |= 1ULL << ((c->base + 1 + i) & 63);
+    }
+    // chunks past base may be marked already (out of order): base is the first gap
+    while (c->base < total && (c->bits[c->base >> 6] >> (c->base & 63) & 1)) c->base++;
+    return c->base;
+}
+
+int sr_ckpt_test(const sr_ckpt_t *c, long seq) {
+    return c->map && seq >= 0 && seq < c->total && (c->bits[seq >> 6] >> (seq & 63) & 1);
+}
+
+// chunk seq is done (written to disk / acked); only the mapping is touched
+void sr_ckpt_mark(sr_ckpt_t *c, long seq) {
+    if (!c->map || seq < c->base || seq >= c->total || sr_ckpt_test(c, seq)) return;
+    c->bits[seq >> 6] |= 1ULL << (seq & 63);
+    c->dirty++;
+    while (c->base < c->total && (c->bits[c->base >> 6] >> (c->base & 63) & 1)) c->base++;
+}
+
+// every chunk below end is done
+void sr_ckpt_mark_upto(sr_ckpt_t *c, long end) {
+    while (c->map && c->base < end) sr_ckpt_mark(c, c->base);
+}
+
+// is a flush due under the -k / -K policy?
+int sr_ckpt_due(const sr_ckpt_t *c, uint64_t now) {
+    if (!c->map || !c->dirty) return 0;
+    return (sr_ckpt_every && c->dirty >= sr_ckpt_every) || (sr_ckpt_ms && now - c->flushed_at >= (uint64_t)sr_ckpt_ms * 1000);
+}
+
+// Make the checkpoint durable: the data it vouches for first (data_fd, -1 if there
+// is none), then the bitmap, then a header in the slot not holding the newest one.
+// A crash anywhere in between leaves the previous generation intact.
+void sr_ckpt_flush(sr_ckpt_t *c, int data_fd) {
+    if (!c->map) return;
+    if (data_fd >= 0) fdatasync(data_fd);
+    size_t blen = sr_ckpt_bits_len(c->total);
+    if (blen) msync(c->map + SR_CKPT_BITS_OFF, blen, MS_SYNC);
+    sr_ckpt_hdr_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SR_CKPT_MAGIC, sizeof(h.magic));
+    h.gen = ++c->gen;
+    h.total_chunks = c->total;
+    h.base = c->base;
+    h.bits_sum = sr_sum64(c->bits, blen);
+    h.chunk_size = c->chunk;
+    h.bytes = c->bytes;
+    h.mtime = c->mtime;
+    for (long i = 0; i < SR_CKPT_TAIL_BITS && c->base + 1 + i < c->total; i++)
+        if (sr_ckpt_test(c, c->base + 1 + i)) h.tail[i >> 3] |= 1u << (i & 7);
+    h.sum = sr_sum64(&h, offsetof(sr_ckpt_hdr_t, sum));
+    c->hdr[h.gen & 1] = h;
+    msync(c->map, SR_CKPT_BITS_OFF, MS_SYNC);
+    c->dirty = 0;
+    c->flushed_at = sr_now_usec();
+    c->flushes++;
+}
+
+// final flush (if anything changed) and unmap
+void sr_ckpt_close(sr_ckpt_t *c, int data_fd) {
+    if (!c->map) return;
+    if (c->dirty || !c->gen) sr_ckpt_flush(c, data_fd);
+    munmap(c->map, c->map_len);
+    close(c->fd);
+    c->map = NULL;
+    c->fd = -1;
+}
+
+// The transfer is complete: sync its data (data_fd) and delete the checkpoint, so
+// the next file by that name starts from chunk 0 instead of resuming onto this one.
+void sr_ckpt_remove(sr_ckpt_t *c, int data_fd) {
+    if (!c->map) return;
+    if (data_fd >= 0) fdatasync(data_fd);
+    munmap(c->map, c->map_len);
+    close(c->fd);
+    c->map = NULL;
+    c->fd = -1;
+    if (unlink(c->path) < 0) log_event("cannot remove checkpoint '%s': %s", c->path, strerror(errno));
+}
+
+// ---------- io_uring backend (-u) ----------
+// Each engine thread owns one ring. Socket receives and sends, file reads (sender)
+// and writes (receiver) and the thread's wait timeout are all SQEs on it, so disk
+// and network I/O overlap and one io_uring_enter() submits a pass's work and waits
+// for the next event. The ring is driven with raw syscalls on the mmap'd SQ/CQ.
+// Completions are routed by the op tag in the top byte of user_data to the
+// callback registered for that op (receive batch, send batch, transfer state).
+#define SR_URING_FILE_DEPTH 64     // file reads/writes in flight per transfer
+
+enum { SR_OP_RECV = 1, SR_OP_SEND, SR_OP_READ, SR_OP_WRITE, SR_OP_TIMEOUT, SR_OP_CANCEL, SR_OP_MAX };
+#define SR_OP_TAG(op, v) (((uint64_t)(op) << 56) | (uint64_t)(v))
+
+typedef void (*sr_uring_cb)(void *ctx, uint64_t val, int res);
+
+typedef struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned sqe_tail;           // SQEs filled; published to the kernel at the next enter
+    sr_uring_cb cb[SR_OP_MAX];
+    void *ctx[SR_OP_MAX];
+    struct __kernel_timespec ts; // the armed wait timeout
+    uint64_t timeout_gen;        // tags it, so a late or cancelled one is ignored
+    int timeout_armed, timed_out;
+    long enters;                 // stats: io_uring_enter calls
+} sr_uring_t;
+
+void sr_uring_free(sr_uring_t *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_len);
+    if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_len);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+int sr_uring_init(sr_uring_t *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+    if (!(p.features & IORING_FEAT_NODROP)) { // need 5.5+: READ/WRITE ops, no lost completions
+        sr_uring_free(r);
+        errno = ENOSYS;
+        return -1;
+    }
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sq_map
+              : mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        sr_uring_free(r);
+        return -1;
+    }
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->sqe_tail = *r->sq_tail;
+    return 0;
+}
+
+// Publish the filled SQEs and, with wait_nr > 0, block until that many completions
+// are in the CQ. Returns the io_uring_enter result (0 if there was nothing to do).
+int sr_uring_enter(sr_uring_t *r, unsigned wait_nr) {
+    unsigned n = r->sqe_tail - *r->sq_tail;
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+    if (!n && !wait_nr) return 0;
+    r->enters++;
+    return syscall(__NR_io_uring_enter, r->fd, n, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// next free SQE, zeroed; a full SQ is submitted first
+struct io_uring_sqe *sr_uring_sqe(sr_uring_t *r) {
+    while (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+        sr_uring_enter(r, 0);
+    unsigned idx = r->sqe_tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    r->sqe_tail++;
+    return sqe;
+}
+
+// Run the callbacks of every completion in the CQ (no syscall). Returns how many.
+int sr_uring_reap(sr_uring_t *r) {
+    int count = 0;
+    unsigned head = *r->cq_head;
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *c = &r->cqes[head & *r->cq_mask];
+        uint64_t ud = c->user_data;
+        int res = c->res;
+        __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE); // callbacks may queue new SQEs
+        int op = ud >> 56;
+        uint64_t val = ud & ((1ULL << 56) - 1);
+        if (op == SR_OP_TIMEOUT) {
+            if (val == r->timeout_gen) {
+                r->timeout_armed = 0;
+                if (res == -ETIME) r->timed_out = 1;
+            }
+        } else if (op > 0 && op < SR_OP_MAX && r->cb[op]) {
+            r->cb[op](r->ctx[op], val, res);
+        }
+        count++;
+    }
+    return count;
+}
+
+// Submit pending SQEs and wait for a completion, at most timeout_usec (< 0: no
+// limit, 0: just poll). Returns 0 if nothing but the timeout completed.
+int sr_uring_wait(sr_uring_t *r, int64_t timeout_usec) {
+    if (timeout_usec == 0 || sr_uring_reap(r)) {
+        sr_uring_enter(r, 0);
+        return sr_uring_reap(r) || timeout_usec;
+    }
+    r->timed_out = 0;
+    if (timeout_usec > 0) {
+        struct io_uring_sqe *sqe = sr_uring_sqe(r);
+        r->ts.tv_sec = timeout_usec / 1000000;
+        r->ts.tv_nsec = (timeout_usec % 1000000) * 1000;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t)&r->ts;
+        sqe->len = 1;
+        sqe->user_data = SR_OP_TAG(SR_OP_TIMEOUT, ++r->timeout_gen);
+        r->timeout_armed = 1;
+    }
+    int n = 0;
+    while (!n) {
+        if (sr_uring_enter(r, 1) < 0 && errno != EINTR) break;
+        n = sr_uring_reap(r);
+    }
+    if (r->timeout_armed) {
+        // woken by I/O first: cancel the timeout (submitted with the next enter)
+        struct io_uring_sqe *sqe = sr_uring_sqe(r);
+        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = SR_OP_TAG(SR_OP_TIMEOUT, r->timeout_gen);
+        sqe->user_data = SR_OP_TAG(SR_OP_CANCEL, 0);
+        r->timeout_armed = 0;
+    }
+    return n > r->timed_out;
+}
+
+void sr_uring_on(sr_uring_t *r, int op, sr_uring_cb cb, void *ctx) {
+    r->cb[op] = cb;
+    r->ctx[op] = ctx;
+}
+
+// the calling thread's ring when -u is given, NULL otherwise (or if io_uring is unavailable)
+sr_uring_t *sr_uring_open(sr_uring_t *r, const char *tag) {
+    if (!sr_use_uring) return NULL;
+    if (sr_uring_init(r, 2 * sr_batch + 2 * SR_URING_FILE_DEPTH + 8) < 0) {
+        log_event("%s io_uring unavailable (%s), using plain syscalls", tag, strerror(errno));
+        fprintf(stderr, "[%s] io_uring unavailable (%s), using plain syscalls\n", tag, strerror(errno));
+        return NULL;
+    }
+    return r;
+}
+
+// ---------- Path MTU ----------
+// A transfer's chunk is the largest whose data packets cross the path unfragmented.
+// The kernel's idea of the path MTU to the peer (the route's MTU, lowered by ICMP
+// "fragmentation needed" answers to DF packets) is read off a throwaway socket
+// connected to it; data sockets send with DF set, so those answers keep coming.
+
+// set (on) or clear DF on everything fd sends
+int sr_path_df(int fd, int on) {
+    int v = on ? IP_PMTUDISC_DO : IP_PMTUDISC_DONT;
+    return setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &v, sizeof(v));
+}
+
+// the path MTU to peer as the kernel knows it, -1 if it cannot tell
+int sr_path_mtu(const sr_peer_t *peer) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    int mtu = -1;
+    socklen_t len = sizeof(mtu);
+    if (sr_path_df(fd, 1) < 0 || connect(fd, (const struct sockaddr *)&peer->addr, peer->len) < 0 ||
+        getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &len) < 0)
+        mtu = -1;
+    close(fd);
+    return mtu;
+}
+
+// chunk for a transfer of win packets to peer: what is left of one unfragmented
+// datagram after the IP, UDP and packet headers (CHUNK_SIZE if the MTU is unknown),
+// kept within -C, SR_MAX_WINDOW_BYTES of window and SR_MIN_CHUNK
+int sr_path_chunk(const sr_peer_t *peer, long win) {
+    int mtu = sr_path_mtu(peer);
+    long chunk = mtu > 0 ? mtu - 20 - 8 - HDR_LEN : CHUNK_SIZE;
+    if (chunk > sr_chunk_max) chunk = sr_chunk_max;
+    if (chunk > SR_MAX_WINDOW_BYTES / win) chunk = SR_MAX_WINDOW_BYTES / win;
+    if (chunk < SR_MIN_CHUNK) chunk = SR_MIN_CHUNK;
+    return (int)chunk;
+}
+
+// ---------- Batched socket I/O ----------
+// Outgoing: packets queue up (header copy + pointer to the payload) until the batch
+// is full or the caller flushes, then leave in as few sendmmsg() calls as possible.
+// With GSO (-G <segs>) consecutive full-size packets share one message: the kernel
+// cuts it into HDR_LEN + seg datagrams (UDP_SEGMENT), so the stack is traversed
+// once per message instead of once per packet. Only the last segment of a message
+// may be shorter.
+typedef struct {
+    int fd;                      // socket the batch goes out on
+    int n, cap;                  // messages queued / per sendmmsg
+    int segs;                    // packets per message (1 = no GSO)
+    int seg;                     // payload bytes of a full packet (the transfer's chunk)
+    int frag;                    // EMSGSIZE: DF was cleared on fd, packets are fragmented
+    struct mmsghdr *msgs;
+    struct iovec *iov;           // two per packet: header, payload
+    char (*hdr)[HDR_LEN];
+    int *nseg;                   // packets in each message
+    int open;                    // last message can still take a segment
+    char (*ctrl)[CMSG_SPACE(sizeof(uint16_t))];
+    sr_uring_t *ring;            // -u: messages go out as SENDMSG SQEs instead of sendmmsg()
+    int inflight;                // SENDMSG SQEs not completed yet
+    // -z: a MSG_ZEROCOPY send keeps its pages (header included) pinned until the
+    // kernel posts its id on the error queue; ids count up from 0 per socket
+    int zc;
+    int zc_off;                  // zerocopy refused for good (e.g. GSO messages with too many fragments)
+    uint32_t zc_sent;            // zerocopy sends so far == id of the next one
+    uint32_t zc_done;            // every id below this has completed
+    uint8_t *zc_fin;             // SR_ZC_IDS ring: completed ids at or past zc_done
+    long zc_copied;              // stats: completions the kernel had to copy after all
+    long calls, pkts, dgrams;    // stats: average fill = pkts / calls
+} sr_sbatch_t;
+
+void sr_sbatch_free(sr_sbatch_t *b) {
+    free(b->msgs);
+    free(b->iov);
+    free(b->hdr);
+    free(b->nseg);
+    free(b->ctrl);
+    free(b->zc_fin);
+    memset(b, 0, sizeof(*b));
+}
+
+int sr_sbatch_alloc(sr_sbatch_t *b, int cap, int segs) {
+    memset(b, 0, sizeof(*b));
+    b->cap = cap;
+    b->segs = segs;
+    b->msgs = calloc(cap, sizeof(*b->msgs));
+    b->iov = calloc(2 * cap * segs, sizeof(*b->iov));
+    b->hdr = calloc(cap * segs, sizeof(*b->hdr));
+    b->nseg = calloc(cap, sizeof(*b->nseg));
+    b->ctrl = calloc(cap, sizeof(*b->ctrl));
+    if (!b->msgs || !b->iov || !b->hdr || !b->nseg || !b->ctrl) {
+        sr_sbatch_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+// switch the batch to MSG_ZEROCOPY sends on the socket; 0 on success
+int sr_sbatch_zerocopy(sr_sbatch_t *b) {
+    int on = 1;
+    if (setsockopt(b->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) return -1;
+    b->zc_fin = calloc(SR_ZC_IDS, 1);
+    if (!b->zc_fin) return -1;
+    b->zc = 1;
+    return 0;
+}
+
+// Read zerocopy completions off the error queue, waiting up to timeout_ms for one
+// if none is queued (0: don't wait). Returns the number of notifications read.
+int sr_sbatch_zc_reap(sr_sbatch_t *b, int timeout_ms) {
+    int got = 0;
+    for (;;) {
+        char ctrl[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+        struct msghdr m;
+        memset(&m, 0, sizeof(m));
+        m.msg_control = ctrl;
+        m.msg_controllen = sizeof(ctrl);
+        if (recvmsg(b->fd, &m, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            if (got || !timeout_ms || errno != EAGAIN) return got;
+            struct pollfd p = { .fd = b->fd, .events = 0 }; // the error queue shows up as POLLERR
+            if (poll(&p, 1, timeout_ms) <= 0) return 0;
+            timeout_ms = 0;
+            continue;
+        }
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c)) {
+            if (c->cmsg_level != SOL_IP || c->cmsg_type != IP_RECVERR) continue;
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+            if (ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // ids ee_info..ee_data completed; they may arrive out of order
+            for (uint32_t id = ee.ee_info; id != ee.ee_data + 1; id++) b->zc_fin[id % SR_ZC_IDS] = 1;
+            if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) b->zc_copied += ee.ee_data - ee.ee_info + 1;
+        }
+        while (b->zc_done != b->zc_sent && b->zc_fin[b->zc_done % SR_ZC_IDS])
+            b->zc_fin[b->zc_done++ % SR_ZC_IDS] = 0;
+        got++;
+    }
+}
+
+// block until every zerocopy send with an id below end has completed
+void sr_sbatch_zc_wait(sr_sbatch_t *b, uint32_t end) {
+    if ((int32_t)(end - b->zc_sent) > 0) end = b->zc_sent; // ids never issued (failed sends) don't count
+    while ((int32_t)(end - b->zc_done) > 0) sr_sbatch_zc_reap(b, 100);
+}
+
+void sr_sbatch_gso_failed(sr_sbatch_t *b, int err) {
+    // no segmentation offload on this path: send one datagram per packet from now on
+    log_event("GSO send failed (%s), falling back to one datagram per packet", strerror(err));
+    b->segs = 1;
+}
+
+// full packets of seg bytes from now on; a GSO send stays within one 64 KB datagram
+void sr_sbatch_seg(sr_sbatch_t *b, int seg) {
+    b->seg = seg;
+    if (b->segs > 1 && b->segs > 65000 / (HDR_LEN + seg)) {
+        b->segs = 65000 / (HDR_LEN + seg);
+        if (b->segs < 2) {
+            log_event("chunks of %d bytes leave no room for GSO, one datagram per packet", seg);
+            b->segs = 1;
+        }
+    }
+}
+
+void sr_sbatch_fragment(sr_sbatch_t *b) {
+    // the path MTU fell below the transfer's packets after it started (an ICMP
+    // "fragmentation needed" came back): let the stack fragment them from now on
+    if (b->frag) return;
+    log_event("path MTU below %d byte packets (%s), sending them fragmented", HDR_LEN + b->seg, strerror(EMSGSIZE));
+    sr_path_df(b->fd, 0);
+    b->frag = 1;
+}
+
+void sr_sbatch_on_send(void *ctx, uint64_t k, int res) {
+    sr_sbatch_t *b = ctx;
+    b->inflight--;
+    if (res >= 0) {
+        b->pkts += b->nseg[k];
+        b->dgrams++;
+    } else if (b->segs > 1 && (res == -EIO || res == -EINVAL)) {
+        sr_sbatch_gso_failed(b, -res);
+    } else if (res == -EMSGSIZE) {
+        sr_sbatch_fragment(b);
+    }
+}
+
+// hand every queued message to the ring in one submission and wait until the
+// kernel is done with them (the batch's headers and iovecs are reused next)
+void sr_sbatch_flush_uring(sr_sbatch_t *b) {
+    for (int k = 0; k < b->n; k++) {
+        struct io_uring_sqe *sqe = sr_uring_sqe(b->ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = b->fd;
+        sqe->addr = (uintptr_t)&b->msgs[k].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = SR_OP_TAG(SR_OP_SEND, k);
+        b->inflight++;
+    }
+    b->calls++;
+    while (b->inflight) {
+        if (sr_uring_enter(b->ring, 1) < 0 && errno != EINTR) break;
+        sr_uring_reap(b->ring);
+    }
+}
+
+void sr_sbatch_flush(sr_sbatch_t *b) {
+    for (int k = 0; k < b->n; k++) {
+        struct msghdr *m = &b->msgs[k].msg_hdr;
+        m->msg_control = NULL;
+        m->msg_controllen = 0;
+        if (b->nseg[k] > 1) {
+            m->msg_control = b->ctrl[k];
+            m->msg_controllen = sizeof(b->ctrl[k]);
+            struct cmsghdr *c = CMSG_FIRSTHDR(m);
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso = HDR_LEN + b->seg;
+            memcpy(CMSG_DATA(c), &gso, sizeof(gso));
+        }
+    }
+    int off = b->ring ? b->n : 0;
+    if (b->ring && b->n) sr_sbatch_flush_uring(b);
+    int flags = b->zc && !b->zc_off ? MSG_ZEROCOPY : 0;
+    while (off < b->n) {
+        if (flags && b->zc_sent - b->zc_done + (b->n - off) > SR_ZC_IDS) {
+            sr_sbatch_zc_reap(b, 100); // too many sends still pinned: let some complete first
+            continue;
+        }
+        int r = sendmmsg(b->fd, b->msgs + off, b->n - off, flags);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0 && errno == ENOBUFS && flags) {
+                // out of socket option memory for pinned pages: wait for completions,
+                // or copy this time if there is nothing left to wait for
+                if (b->zc_sent != b->zc_done) sr_sbatch_zc_reap(b, 100);
+                else flags = 0;
+                continue;
+            }
+            if (r < 0 && errno == EMSGSIZE && flags) {
+                // a GSO message pins more fragments than one skb holds: copy from now on
+                // (ids already issued are still tracked, so slots stay safe)
+                log_event("MSG_ZEROCOPY send refused (%s), copying from now on", strerror(errno));
+                b->zc_off = 1;
+                flags = 0;
+                continue;
+            }
+            if (r < 0 && errno == EMSGSIZE && !b->frag) {
+                sr_sbatch_fragment(b);
+                continue;
+            }
+            if (r < 0 && b->segs > 1 && (errno == EIO || errno == EINVAL)) sr_sbatch_gso_failed(b, errno);
+            break; // the rest counts as lost; its retransmission timers are armed
+        }
+        for (int k = off; k < off + r; k++) b->pkts += b->nseg[k];
+        if (flags) b->zc_sent += r;
+        off += r;
+        b->calls++;
+        b->dgrams += r;
+    }
+    b->n = 0;
+    b->open = 0;
+}
+
+// queue one packet; its header is copied, the payload must stay put until the flush
+// (with -z both are referenced, and must stay put until the send completes)
+void sr_sbatch_add(sr_peer_t *peer, sr_sbatch_t *b, const char *hdr, const char *data, int len) {
+    int k = b->n - 1;
+    if (!b->open || b->nseg[k] == b->segs) {
+        if (b->n == b->cap) sr_sbatch_flush(b);
+        k = b->n++;
+        b->nseg[k] = 0;
+        struct msghdr *m = &b->msgs[k].msg_hdr;
+        m->msg_name = &peer->addr;
+        m->msg_namelen = peer->len;
+        m->msg_iov = &b->iov[2 * k * b->segs];
+        m->msg_iovlen = 0;
+    }
+    struct msghdr *m = &b->msgs[k].msg_hdr;
+    int j = k * b->segs + b->nseg[k]++;
+    if (!b->zc) {
+        memcpy(b->hdr[j], hdr, HDR_LEN);
+        hdr = b->hdr[j];
+    }
+    m->msg_iov[m->msg_iovlen].iov_base = (void *)hdr;
+    m->msg_iov[m->msg_iovlen++].iov_len = HDR_LEN;
+    m->msg_iov[m->msg_iovlen].iov_base = (void *)data;
+    m->msg_iov[m->msg_iovlen++].iov_len = len;
+    b->open = b->segs > 1 && len == b->seg; // a short packet must end its message
+    if (b->n == b->cap && (!b->open || b->nseg[k] == b->segs)) sr_sbatch_flush(b);
+}
+
+// Incoming: up to cap datagrams per recvmmsg(), each with its own buffer and source address.
+// With GRO the kernel may hand over several same-size datagrams as one buffer and
+// report the segment size in a UDP_GRO cmsg; sr_rbatch_next() splits it up again.
+typedef struct {
+    int cap;
+    int bufsize;                 // MAX_PKT, or SR_GRO_BUF with GRO
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    char *bufs;                  // cap buffers of bufsize + 1 (text messages are NUL-terminated in place)
+    struct sockaddr_in *addrs;
+    char (*ctrl)[CMSG_SPACE(sizeof(int))];
+    int *order;                  // buffer index of each datagram of the current batch
+    int got, next, off;          // cursor of sr_rbatch_next
+    char held;                   // byte under the NUL written past the previous segment
+    // -u: every buffer not handed out is posted as a RECVMSG SQE; completions
+    // queue up in done[] until the next sr_rbatch_recv
+    sr_uring_t *ring;
+    int fd;
+    int *done, ndone;
+    long calls, pkts;
+} sr_rbatch_t;
+
+void sr_rbatch_free(sr_rbatch_t *b) {
+    free(b->msgs);
+    free(b->iov);
+    free(b->bufs);
+    free(b->addrs);
+    free(b->ctrl);
+    free(b->order);
+    free(b->done);
+    memset(b, 0, sizeof(*b));
+}
+
+int sr_rbatch_alloc(sr_rbatch_t *b, int cap, int gro) {
+    memset(b, 0, sizeof(*b));
+    b->cap = cap;
+    b->bufsize = gro ? SR_GRO_BUF : MAX_PKT;
+    b->msgs = calloc(cap, sizeof(*b->msgs));
+    b->iov = calloc(cap, sizeof(*b->iov));
+    b->bufs = malloc((size_t)cap * (b->bufsize + 1));
+    b->addrs = calloc(cap, sizeof(*b->addrs));
+    b->ctrl = calloc(cap, sizeof(*b->ctrl));
+    b->order = calloc(cap, sizeof(*b->order));
+    b->done = calloc(cap, sizeof(*b->done));
+    if (!b->msgs || !b->iov || !b->bufs || !b->addrs || !b->ctrl || !b->order || !b->done) {
+        sr_rbatch_free(b);
+        return -1;
+    }
+    for (int i = 0; i < cap; i++) {
+        b->order[i] = i;
+        b->iov[i].iov_base = b->bufs + (size_t)i * (b->bufsize + 1);
+        b->iov[i].iov_len = b->bufsize;
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+        b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+    }
+    return 0;
+}
+
+void sr_rbatch_reset(sr_rbatch_t *b, int i) {
+    b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+    b->msgs[i].msg_hdr.msg_control = b->ctrl[i];
+    b->msgs[i].msg_hdr.msg_controllen = sizeof(b->ctrl[i]);
+}
+
+void sr_rbatch_post(sr_rbatch_t *b, int i) {
+    sr_rbatch_reset(b, i);
+    struct io_uring_sqe *sqe = sr_uring_sqe(b->ring);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = b->fd;
+    sqe->addr = (uintptr_t)&b->msgs[i].msg_hdr;
+    sqe->len = 1;
+    sqe->user_data = SR_OP_TAG(SR_OP_RECV, i);
+}
+
+void sr_rbatch_on_recv(void *ctx, uint64_t i, int res) {
+    sr_rbatch_t *b = ctx;
+    b->msgs[i].msg_len = res > 0 ? res : 0;
+    b->done[b->ndone++] = i;
+}
+
+// switch the batch to the ring: all of its buffers become outstanding receives on fd
+void sr_rbatch_attach(sr_rbatch_t *b, sr_uring_t *ring, int fd) {
+    b->ring = ring;
+    b->fd = fd;
+    sr_uring_on(ring, SR_OP_RECV, sr_rbatch_on_recv, b);
+    for (int i = 0; i < b->cap; i++) sr_rbatch_post(b, i);
+    sr_uring_enter(ring, 0);
+}
+
+// back to recvmmsg(); the ring's outstanding receives go away with the ring
+void sr_rbatch_detach(sr_rbatch_t *b) {
+    b->ring = NULL;
+    b->got = b->next = b->off = b->ndone = 0;
+    for (int i = 0; i < b->cap; i++) b->order[i] = i;
+}
+
+// the previous batch has been read: its buffers go back to the kernel
+void sr_rbatch_repost(sr_rbatch_t *b) {
+    for (int k = 0; k < b->got; k++) sr_rbatch_post(b, b->order[k]);
+    b->got = b->next = b->off = 0;
+}
+
+// returns the number of datagrams received, <= 0 on error; read them with sr_rbatch_next
+int sr_rbatch_recv(sr_rbatch_t *b, int fd, int flags) {
+    int r;
+    if (b->ring) {
+        sr_rbatch_repost(b);
+        sr_uring_wait(b->ring, 0);
+        while (!b->ndone && !(flags & MSG_DONTWAIT)) sr_uring_wait(b->ring, -1);
+        r = b->ndone;
+        memcpy(b->order, b->done, r * sizeof(int));
+        b->ndone = 0;
+    } else {
+        for (int i = 0; i < b->cap; i++) sr_rbatch_reset(b, i);
+        r = recvmmsg(fd, b->msgs, b->cap, flags, NULL);
+    }
+    b->got = r > 0 ? r : 0;
+    b->next = b->off = 0;
+    if (r > 0) {
+        b->calls++;
+        b->pkts += r;
+    }
+    return r;
+}
+
+// Wait until a datagram can be read or timeout_usec passes (< 0: no timeout), like
+// sr_wait_readable. With the ring it may also return 0 early because other I/O
+// (a file read or write) completed; callers re-check their timers and loop.
+int sr_rbatch_wait(sr_rbatch_t *b, int fd, int64_t timeout_usec) {
+    if (!b->ring) return sr_wait_readable(fd, timeout_usec);
+    sr_rbatch_repost(b);
+    if (!b->ndone) sr_uring_wait(b->ring, timeout_usec);
+    return b->ndone > 0;
+}
+
+// Next packet of the batch (one GRO segment at a time): 1 with *buf, *n and the
+// sender's address filled in, 0 once the batch is used up. buf[*n] may be overwritten.
+int sr_rbatch_next(sr_rbatch_t *b, char **buf, int *n, struct sockaddr_in *from) {
+    if (b->next >= b->got) return 0;
+    int i = b->order[b->next];
+    struct msghdr *m = &b->msgs[i].msg_hdr;
+    char *base = b->iov[i].iov_base;
+    int len = b->msgs[i].msg_len, seg = len;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(m); c; c = CMSG_NXTHDR(m, c)) {
+        if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+            int gso;
+            memcpy(&gso, CMSG_DATA(c), sizeof(gso));
+            if (gso > 0) seg = gso;
+        }
+    }
+    if (b->off) base[b->off] = b->held; // undo the caller's NUL past the previous segment
+    *buf = base + b->off;
+    *n = len - b->off < seg ? len - b->off : seg;
+    if (from) *from = b->addrs[i];
+    b->off += *n;
+    if (b->off < len) {
+        b->held = base[b->off];
+        b->pkts++; // one more packet than recvmmsg counted
+    } else {
+        b->next++;
+        b->off = 0;
+    }
+    return 1;
+}
+
+// turn on receive coalescing for the socket (-G); 0 if the kernel supports it
+int sr_enable_gro(int fd) {
+    int on = 1;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+}
+
+void sr_batch_report(const sr_peer_t *peer, const char *what, long calls, long pkts) {
+    log_event("%s BATCH %s pkts=%ld calls=%ld avg_fill=%.1f (batch %d)",
+              peer->tag, what, pkts, calls, calls ? (double)pkts / calls : 0.0, sr_batch);
+}
+
+// CPU the calling thread spent since *start, per GB of payload (compare -z / -m / chunk sizes)
+void sr_cpu_report(const sr_peer_t *peer, const struct rusage *start, long bytes, int chunk, int zerocopy) {
+    struct rusage now;
+    getrusage(RUSAGE_THREAD, &now);
+    double user = (now.ru_utime.tv_sec - start->ru_utime.tv_sec) + (now.ru_utime.tv_usec - start->ru_utime.tv_usec) / 1e6;
+    double sys = (now.ru_stime.tv_sec - start->ru_stime.tv_sec) + (now.ru_stime.tv_usec - start->ru_stime.tv_usec) / 1e6;
+    double gb = bytes / 1e9;
+    log_event("%s CPU user=%.3fs sys=%.3fs bytes=%ld chunk=%d cpu_per_gb=%.3fs%s%s", peer->tag, user, sys, bytes,
+              chunk, gb > 0 ? (user + sys) / gb : 0.0, zerocopy ? " zerocopy" : "", sr_use_mmap ? " mmap" : "");
+}
+
+// ---------- Bitmaps ----------
+// One bit per window slot. Scans test 64 slots per step and use ctz to find
+// the exact bit, so sliding over a run of acked/present slots is cheap even
+// for windows of 64K packets.
+typedef struct {
+    uint64_t *w;
+    long nbits;
+} sr_bitmap_t;
+
+int bm_init(sr_bitmap_t *b, long nbits) {
+    b->nbits = nbits;
+    b->w = calloc((nbits + 63) / 64, sizeof(uint64_t));
+    return b->w ? 0 : -1;
+}
+void bm_free(sr_bitmap_t *b) {
+    free(b->w);
+    b->w = NULL;
+    b->nbits = 0;
+}
+static inline int bm_test(const sr_bitmap_t *b, long i) { return (b->w[i >> 6] >> (i & 63)) & 1; }
+static inline void bm_set(sr_bitmap_t *b, long i) { b->w[i >> 6] |= 1ULL << (i & 63); }
+static inline void bm_clear(sr_bitmap_t *b, long i) { b->w[i >> 6] &= ~(1ULL << (i & 63)); }
+
+// first bit index in [from, to) whose value is `val`, or `to` if there is none
+long bm_scan(const sr_bitmap_t *b, long from, long to, int val) {
+    while (from < to) {
+        uint64_t word = b->w[from >> 6];
+        if (!val) word = ~word;
+        word &= ~0ULL << (from & 63);
+        if (word) {
+            long i = (from & ~63L) + __builtin_ctzll(word);
+            return i < to ? i : to;
+        }
+        from = (from | 63) + 1;
+    }
+    return to;
+}
+
+// Same scan over sequence numbers: seq maps to bit seq & mask, so the range
+// [from, to) (at most one ring long) is split where it wraps.
+long sr_ring_scan(const sr_bitmap_t *b, long mask, long from, long to, int val) {
+    while (from < to) {
+        long slot = from & mask;
+        long run = mask + 1 - slot;
+        if (run > to - from) run = to - from;
+        long hit = bm_scan(b, slot, slot + run, val);
+        if (hit < slot + run) return from + (hit - slot);
+        from += run;
+    }
+    return to;
+}
+
+// number of set bits in [from, to)
+long bm_count(const sr_bitmap_t *b, long from, long to) {
+    long c = 0;
+    while (from < to) {
+        uint64_t word = b->w[from >> 6] & (~0ULL << (from & 63));
+        long end = (from | 63) + 1;
+        if (end > to) {
+            word &= ~0ULL >> (64 - (to & 63));
+            end = to;
+        }
+        c += __builtin_popcountll(word);
+        from = end;
+    }
+    return c;
+}
+
+// set bits among seqs [from, to), split at the wrap like sr_ring_scan
+long sr_ring_count(const sr_bitmap_t *b, long mask, long from, long to) {
+    long c = 0;
+    while (from < to) {
+        long slot = from & mask;
+        long run = mask + 1 - slot;
+        if (run > to - from) run = to - from;
+        c += bm_count(b, slot, slot + run);
+        from += run;
+    }
+    return c;
+}
+
+// smallest power of two >= w, so slot lookup is seq & (cap - 1)
+long sr_ring_capacity(long w) {
+    long cap = 1;
+    while (cap < w) cap <<= 1;
+    return cap;
+}
+
+// ---------- RTT estimation / RTO ----------
+typedef struct {
+    long srtt;                   // smoothed RTT (usec), 0 until the first sample
+    long rttvar;                 // RTT variation (usec)
+    long rto;                    // current timeout, including backoff
+    int backoff;                 // consecutive timeouts without a valid sample
+    long samples, karn_skipped, retransmits, timeouts; // stats
+} sr_rtt_t;
+
+long sr_rto_clamp(long rto) {
+    if (rto < SR_RTO_MIN_USEC) return SR_RTO_MIN_USEC;
+    if (rto > SR_RTO_MAX_USEC) return SR_RTO_MAX_USEC;
+    return rto;
+}
+
+void sr_rtt_init(sr_rtt_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->rto = TIMEOUT_USEC;
+}
+
+// RFC 6298: first sample sets SRTT = R, RTTVAR = R/2; then
+// RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R, RTO = SRTT + 4 RTTVAR
+void sr_rtt_sample(sr_rtt_t *r, long rtt) {
+    if (rtt <= 0) rtt = 1;
+    if (r->samples == 0) {
+        r->srtt = rtt;
+        r->rttvar = rtt / 2;
+    } else {
+        long err = r->srtt - rtt;
+        if (err < 0) err = -err;
+        r->rttvar = (3 * r->rttvar + err) / 4;
+        r->srtt = (7 * r->srtt + rtt) / 8;
+    }
+    r->samples++;
+    r->backoff = 0; // a valid sample ends Karn's backoff
+    r->rto = sr_rto_clamp(r->srtt + 4 * r->rttvar);
+}
+
+// timeout: double the RTO and keep it until a sample from a fresh transmission arrives
+void sr_rtt_backoff(sr_rtt_t *r) {
+    r->timeouts++;
+    r->backoff++;
+    r->rto = sr_rto_clamp(r->rto * 2);
+}
+
+void sr_rtt_report(const sr_peer_t *peer, const char *fname, const sr_rtt_t *r) {
+    log_event("%s RTT '%s' srtt=%ldus rttvar=%ldus rto=%ldus samples=%ld karn_skipped=%ld retransmits=%ld timeouts=%ld",
+              peer->tag, fname, r->srtt, r->rttvar, r->rto, r->samples, r->karn_skipped, r->retransmits, r->timeouts);
+    printf("[%s] RTT srtt=%ldus rttvar=%ldus rto=%ldus samples=%ld karn_skipped=%ld retransmits=%ld timeouts=%ld\n",
+           peer->tag, r->srtt, r->rttvar, r->rto, r->samples, r->karn_skipped, r->retransmits, r->timeouts);
+}
+
+// ---------- Congestion control ----------
+// A controller only sees events; the sender owns loss detection and recovery.
+//   on_ack     : one sr_ack_sample_t per SACK that acknowledged new data
+//   on_loss    : SACK-detected loss, called once per window of data
+//   on_timeout : retransmission timeout, called once per backoff
+// cwnd and ssthresh are in packets (double, so congestion avoidance can grow by 1/cwnd).
+// pacing_rate is in packets per second; 0 leaves the sender unpaced.
+typedef struct sr_cc sr_cc_t;
+
+typedef struct {
+    long acked;                  // packets newly acked (cumulative or SACKed)
+    long delivered;              // packets delivered so far, this ACK included
+    long prior_delivered;        // `delivered` when the newest acked packet was sent
+    double rate;                 // delivery rate sample (packets/s), 0 if none
+    long rtt;                    // RTT sample (usec), 0 if Karn's rule rejected it
+    long srtt;
+    long inflight;               // packets still in flight after this ACK
+    int recovering;              // inside fast recovery
+    uint64_t now;
+} sr_ack_sample_t;
+
+typedef struct sr_cc_ops {
+    const char *name;
+    void (*on_ack)(sr_cc_t *cc, const sr_ack_sample_t *a);
+    void (*on_loss)(sr_cc_t *cc, uint64_t now);
+    void (*on_timeout)(sr_cc_t *cc, uint64_t now);
+} sr_cc_ops_t;
+
+#define SR_BBR_BW_ROUNDS 10      // bottleneck bandwidth = max delivery rate over this many round trips
+
+struct sr_cc {
+    const sr_cc_ops_t *ops;
+    double cwnd;
+    double ssthresh;
+    long rwnd;                   // receiver window: cwnd never grows past it
+    double pacing_rate;
+    // CUBIC state
+    double w_max;                // cwnd before the last reduction
+    double k;                    // seconds until the cubic curve is back at w_max
+    double w_est;                // Reno-equivalent window (TCP-friendly region)
+    uint64_t epoch;              // start of the current growth epoch, 0 = not started
+    // BBR state
+    int mode;                    // SR_BBR_STARTUP / DRAIN / PROBE_BW
+    double btl_bw;               // bottleneck bandwidth estimate (packets/s)
+    double bw_round[SR_BBR_BW_ROUNDS]; // max rate sample per round trip
+    long round, next_round_delivered;
+    long min_rtt;                // usec, 0 until the first sample
+    uint64_t min_rtt_at;
+    double full_bw;              // STARTUP ends when bw stops growing 25% for 3 rounds
+    int full_bw_rounds;
+    int cycle;                   // PROBE_BW gain cycle phase
+    uint64_t cycle_at;
+    long losses, timeouts;       // stats
+};
+
+void sr_cc_clamp(sr_cc_t *cc) {
+    if (cc->cwnd > cc->rwnd) cc->cwnd = cc->rwnd;
+    if (cc->cwnd < 1) cc->cwnd = 1;
+}
+
+// slow start: one packet per packet acked, up to ssthresh; returns the acks left over
+long sr_cc_slow_start(sr_cc_t *cc, long acked) {
+    if (cc->cwnd >= cc->ssthresh) return acked;
+    double room = cc->ssthresh - cc->cwnd;
+    if (acked <= room) {
+        cc->cwnd += acked;
+        return 0;
+    }
+    cc->cwnd = cc->ssthresh;
+    return acked - (long)room;
+}
+
+// NewReno (RFC 5681/6582): +1 packet per RTT in congestion avoidance, halve on loss
+void sr_newreno_on_ack(sr_cc_t *cc, const sr_ack_sample_t *a) {
+    if (a->recovering) return; // cwnd is frozen until the hole is repaired
+    long acked = sr_cc_slow_start(cc, a->acked);
+    if (acked) cc->cwnd += (double)acked / cc->cwnd;
+    sr_cc_clamp(cc);
+}
+
+void sr_newreno_on_loss(sr_cc_t *cc, uint64_t now) {
+    (void)now;
+    cc->ssthresh = cc->cwnd / 2 > 2 ? cc->cwnd / 2 : 2;
+    cc->cwnd = cc->ssthresh;
+}
+
+void sr_newreno_on_timeout(sr_cc_t *cc, uint64_t now) {
+    sr_newreno_on_loss(cc, now);
+    cc->cwnd = 1;
+}
+
+// CUBIC (RFC 8312): after a loss cwnd follows W(t) = C (t - K)^3 + W_max,
+// and never grows slower than the Reno-equivalent w_est
+#define SR_CUBIC_C 0.4
+#define SR_CUBIC_BETA 0.7
+
+// cube root by Newton's method (keeps the single-file compile lines free of -lm)
+double sr_cbrt(double x) {
+    if (x <= 0) return 0;
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 100; i++) {
+        double next = (2 * r + x / (r * r)) / 3;
+        if (next >= r) break;
+        r = next;
+    }
+    return r;
+}
+
+void sr_cubic_on_ack(sr_cc_t *cc, const sr_ack_sample_t *a) {
+    if (a->recovering) return;
+    long acked = sr_cc_slow_start(cc, a->acked);
+    uint64_t now = a->now;
+    if (!acked) return;
+    if (!cc->epoch) {
+        cc->epoch = now;
+        cc->w_est = cc->cwnd;
+        if (cc->w_max > cc->cwnd) {
+            cc->k = sr_cbrt((cc->w_max - cc->cwnd) / SR_CUBIC_C);
+        } else {
+            cc->k = 0;
+            cc->w_max = cc->cwnd;
+        }
+    }
+    // aim for where the curve will be one RTT from now
+    double t = (double)(now - cc->epoch + a->srtt) / 1e6 - cc->k;
+    double target = SR_CUBIC_C * t * t * t + cc->w_max;
+    if (target > 1.5 * cc->cwnd) target = 1.5 * cc->cwnd;
+    if (target > cc->cwnd) cc->cwnd += (target - cc->cwnd) / cc->cwnd * acked;
+    else cc->cwnd += 0.01 * acked / cc->cwnd;
+    cc->w_est += 3 * (1 - SR_CUBIC_BETA) / (1 + SR_CUBIC_BETA) * acked / cc->cwnd;
+    if (cc->w_est > cc->cwnd) cc->cwnd = cc->w_est;
+    sr_cc_clamp(cc);
+}
+
+void sr_cubic_on_loss(sr_cc_t *cc, uint64_t now) {
+    (void)now;
+    cc->epoch = 0;
+    // fast convergence: a flow that lost before reaching its old maximum yields some of it
+    cc->w_max = cc->cwnd < cc->w_max ? cc->cwnd * (1 + SR_CUBIC_BETA) / 2 : cc->cwnd;
+    cc->ssthresh = cc->cwnd * SR_CUBIC_BETA > 2 ? cc->cwnd * SR_CUBIC_BETA : 2;
+    cc->cwnd = cc->ssthresh;
+}
+
+void sr_cubic_on_timeout(sr_cc_t *cc, uint64_t now) {
+    sr_cubic_on_loss(cc, now);
+    cc->cwnd = 1;
+}
+
+// BBR (v1 outline): the path is modelled as bottleneck bandwidth (windowed max of
+// delivery-rate samples) and min RTT; the sender paces at pacing_gain x btl_bw and keeps
+// cwnd_gain x BDP in flight. STARTUP doubles the rate each round until bandwidth stops
+// growing, DRAIN empties the queue that built, PROBE_BW then cycles the gain
+// 1.25 (probe) / 0.75 (drain) / 1 x 6, one min RTT per phase. Loss is not a model input.
+#define SR_BBR_STARTUP 0
+#define SR_BBR_DRAIN 1
+#define SR_BBR_PROBE_BW 2
+#define SR_BBR_HIGH_GAIN 2.885         // 2/ln2: doubles the sending rate every round
+#define SR_BBR_CWND_GAIN 2.0
+#define SR_BBR_MIN_RTT_USEC 10000000   // min RTT sample expires after 10 s
+#define SR_BBR_MIN_CWND 4
+#define SR_BBR_INIT_RTT_USEC 1000      // RTT assumed for the initial pacing rate
+
+const double sr_bbr_cycle_gain[8] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+double sr_bbr_bdp(const sr_cc_t *cc) {
+    return cc->btl_bw * cc->min_rtt / 1e6;
+}
+
+void sr_bbr_on_ack(sr_cc_t *cc, const sr_ack_sample_t *a) {
+    if (a->rtt > 0 && (!cc->min_rtt || a->rtt <= cc->min_rtt || a->now - cc->min_rtt_at > SR_BBR_MIN_RTT_USEC)) {
+        cc->min_rtt = a->rtt;
+        cc->min_rtt_at = a->now;
+    }
+    // a round trip ends when a packet sent after the previous round's end is acked
+    int round_start = 0;
+    if (a->prior_delivered >= cc->next_round_delivered) {
+        cc->next_round_delivered = a->delivered;
+        cc->round++;
+        cc->bw_round[cc->round % SR_BBR_BW_ROUNDS] = 0;
+        round_start = 1;
+    }
+    double *slot = &cc->bw_round[cc->round % SR_BBR_BW_ROUNDS];
+    if (a->rate > *slot) *slot = a->rate;
+    cc->btl_bw = 0;
+    for (int i = 0; i < SR_BBR_BW_ROUNDS; i++)
+        if (cc->bw_round[i] > cc->btl_bw) cc->btl_bw = cc->bw_round[i];
+
+    double bdp = sr_bbr_bdp(cc);
+    if (cc->mode == SR_BBR_STARTUP && round_start && cc->btl_bw > 0) {
+        if (cc->btl_bw >= cc->full_bw * 1.25) {
+            cc->full_bw = cc->btl_bw;
+            cc->full_bw_rounds = 0;
+        } else if (++cc->full_bw_rounds >= 3) {
+            cc->mode = SR_BBR_DRAIN;
+        }
+    }
+    if (cc->mode == SR_BBR_DRAIN && a->inflight <= bdp) {
+        cc->mode = SR_BBR_PROBE_BW;
+        cc->cycle = 0;
+        cc->cycle_at = a->now;
+    }
+    if (cc->mode == SR_BBR_PROBE_BW && a->now - cc->cycle_at > (uint64_t)cc->min_rtt) {
+        cc->cycle = (cc->cycle + 1) % 8;
+        cc->cycle_at = a->now;
+    }
+
+    double pacing_gain = cc->mode == SR_BBR_STARTUP ? SR_BBR_HIGH_GAIN
+                       : cc->mode == SR_BBR_DRAIN ? 1 / SR_BBR_HIGH_GAIN : sr_bbr_cycle_gain[cc->cycle];
+    double cwnd_gain = cc->mode == SR_BBR_PROBE_BW ? SR_BBR_CWND_GAIN : SR_BBR_HIGH_GAIN;
+    double target = cwnd_gain * bdp;
+    // grow toward the model's target; until the pipe is known to be full, just keep growing
+    if (cc->mode != SR_BBR_STARTUP) cc->cwnd = cc->cwnd + a->acked < target ? cc->cwnd + a->acked : target;
+    else if (cc->cwnd < target || !bdp) cc->cwnd += a->acked;
+    if (cc->cwnd < SR_BBR_MIN_CWND) cc->cwnd = SR_BBR_MIN_CWND;
+    sr_cc_clamp(cc);
+    if (cc->btl_bw > 0) cc->pacing_rate = pacing_gain * cc->btl_bw;
+    else cc->pacing_rate = pacing_gain * cc->cwnd * 1e6 / (a->srtt ? a->srtt : SR_BBR_INIT_RTT_USEC);
+}
+
+void sr_bbr_on_loss(sr_cc_t *cc, uint64_t now) {
+    (void)cc; (void)now; // the model ignores loss; the sender still repairs the hole
+}
+
+void sr_bbr_on_timeout(sr_cc_t *cc, uint64_t now) {
+    (void)now;
+    cc->cwnd = 1; // packet conservation; the next ACKs rebuild cwnd from the model
+}
+
+const sr_cc_ops_t sr_cc_newreno = { "newreno", sr_newreno_on_ack, sr_newreno_on_loss, sr_newreno_on_timeout };
+const sr_cc_ops_t sr_cc_cubic = { "cubic", sr_cubic_on_ack, sr_cubic_on_loss, sr_cubic_on_timeout };
+const sr_cc_ops_t sr_cc_bbr = { "bbr", sr_bbr_on_ack, sr_bbr_on_loss, sr_bbr_on_timeout };
+const sr_cc_ops_t *sr_cc_algos[] = { &sr_cc_newreno, &sr_cc_cubic, &sr_cc_bbr, NULL };
+
+const sr_cc_ops_t *sr_cc_find(const char *name) {
+    for (int i = 0; sr_cc_algos[i]; i++)
+        if (strcmp(sr_cc_algos[i]->name, name) == 0) return sr_cc_algos[i];
+    return NULL;
+}
+
+void sr_cc_init(sr_cc_t *cc, const sr_cc_ops_t *ops, long rwnd) {
+    memset(cc, 0, sizeof(*cc));
+    cc->ops = ops;
+    cc->rwnd = rwnd;
+    cc->cwnd = SR_INIT_CWND;
+    cc->ssthresh = rwnd;
+    sr_cc_clamp(cc);
+    if (ops == &sr_cc_bbr) cc->pacing_rate = SR_BBR_HIGH_GAIN * cc->cwnd * 1e6 / SR_BBR_INIT_RTT_USEC;
+}
+
+// whole packets the controller lets into flight
+long sr_cc_window(const sr_cc_t *cc) {
+    return (long)cc->cwnd;
+}
+
+void sr_cc_report(const sr_peer_t *peer, const char *fname, const sr_cc_t *cc) {
+    log_event("%s CC '%s' %s cwnd=%.1f ssthresh=%.1f losses=%ld timeouts=%ld pacing=%.0fpps btl_bw=%.0fpps min_rtt=%ldus",
+              peer->tag, fname, cc->ops->name, cc->cwnd, cc->ssthresh, cc->losses, cc->timeouts,
+              cc->pacing_rate, cc->btl_bw, cc->min_rtt);
+    printf("[%s] CC %s cwnd=%.1f ssthresh=%.1f losses=%ld timeouts=%ld pacing=%.0fpps\n",
+           peer->tag, cc->ops->name, cc->cwnd, cc->ssthresh, cc->losses, cc->timeouts, cc->pacing_rate);
+}
+
+// ---------- Text messages ----------
+// FILE_START, FILE_END, hello and exit go out as text behind the session id
+void sr_send_text(const sr_peer_t *peer, const char *text) {
+    char msg[SID_LEN + 2048];
+    uint32_t sid_net = htonl(peer->sid);
+    int n = strlen(text);
+    if (n > (int)sizeof(msg) - SID_LEN) n = sizeof(msg) - SID_LEN;
+    memcpy(msg, &sid_net, SID_LEN);
+    memcpy(msg + SID_LEN, text, n);
+    sendto(peer->fd, msg, SID_LEN + n, 0, (struct sockaddr *)&peer->addr, peer->len);
+}
+
+// ---------- SACK encode / decode ----------
+typedef struct {
+    uint32_t sid;
+    uint16_t stream;
+    uint32_t cum_ack;
+    uint32_t ts_echo;
+    int loss;                    // receiver's loss estimate, 1/10000
+    int nbits;
+    const uint8_t *bits;         // points into the received frame
+} sr_sack_t;
+
+// Build a frame from the receiver's present bitmap. `limit` caps how many seqs
+// past cum_ack are described (the receive window). Returns the frame length.
+int sr_sack_encode(char *out, const char *magic, uint32_t sid, uint16_t stream, uint32_t cum_ack, uint32_t ts_echo,
+                   int loss, const sr_bitmap_t *present, long mask, long limit) {
+    uint8_t *bits = (uint8_t *)out + SACK_HDR_LEN;
+    long first = (long)cum_ack + 1;
+    if (limit > SACK_MAX_BITS) limit = SACK_MAX_BITS;
+    int nbits = 0;
+    memset(bits, 0, (limit + 7) / 8);
+    for (long s = sr_ring_scan(present, mask, first, first + limit, 1); s < first + limit;
+         s = sr_ring_scan(present, mask, s + 1, first + limit, 1)) {
+        long i = s - first;
+        bits[i >> 3] |= 1u << (i & 7);
+        nbits = i + 1;
+    }
+    uint32_t sid_net = htonl(sid), cum_net = htonl(cum_ack), ts_net = htonl(ts_echo);
+    uint16_t stream_net = htons(stream), nbits_net = htons((uint16_t)nbits), loss_net = htons((uint16_t)loss);
+    memcpy(out, &sid_net, 4);
+    memcpy(out + 4, magic, 4);
+    memcpy(out + 8, &stream_net, 2);
+    memcpy(out + 10, &cum_net, 4);
+    memcpy(out + 14, &ts_net, 4);
+    memcpy(out + 18, &nbits_net, 2);
+    memcpy(out + 20, &loss_net, 2);
+    return SACK_HDR_LEN + (nbits + 7) / 8;
+}
+
+// 0 if buf holds a well-formed frame with this magic (SACK or RESUME), -1 otherwise
+int sr_sack_decode(const char *buf, int n, const char *magic, sr_sack_t *sk) {
+    if (n < SACK_HDR_LEN || memcmp(buf + 4, magic, 4) != 0) return -1;
+    uint32_t sid_net, cum_net, ts_net;
+    uint16_t stream_net, nbits_net, loss_net;
+    memcpy(&sid_net, buf, 4);
+    memcpy(&stream_net, buf + 8, 2);
+    memcpy(&cum_net, buf + 10, 4);
+    memcpy(&ts_net, buf + 14, 4);
+    memcpy(&nbits_net, buf + 18, 2);
+    memcpy(&loss_net, buf + 20, 2);
+    sk->sid = ntohl(sid_net);
+    sk->stream = ntohs(stream_net);
+    sk->cum_ack = ntohl(cum_net);
+    sk->ts_echo = ntohl(ts_net);
+    sk->nbits = ntohs(nbits_net);
+    sk->loss = ntohs(loss_net);
+    sk->bits = (const uint8_t *)buf + SACK_HDR_LEN;
+    if (sk->nbits > SACK_MAX_BITS || n < SACK_HDR_LEN + (sk->nbits + 7) / 8) return -1;
+    return 0;
+}
+
+// 1 if buf looks like a SACK or RESUME frame (for a sender), 0 for data and text (for a receiver)
+int sr_is_frame(const char *buf, int n) {
+    return n >= SACK_HDR_LEN && (!memcmp(buf + SID_LEN, SACK_MAGIC, 4) || !memcmp(buf + SID_LEN, RESUME_MAGIC, 4));
+}
+
+// ---------- Forward error correction (-F) ----------
+// Parity j of a group is p_j = sum over i of c(j, i) * d_i in GF(256) (polynomial 0x11d),
+// d_i being the group's chunk i zero-padded to its longest. c is a Cauchy matrix,
+// 1 / (x_j + y_i) with x_j = j and y_i = SR_FEC_MAX_PARITY + i, its columns scaled by
+// y_i so that row 0 is all ones (parity 0 is the XOR of the group). Every square
+// submatrix of a Cauchy matrix is invertible, and scaling columns keeps it so: the e
+// chunks a group misses are the solution of the e x e system the rows of any e of its
+// parity packets give, once the chunks that did arrive are subtracted out.
+uint8_t sr_gf_exp[510], sr_gf_log[256];
+uint8_t sr_fec_coefs[SR_FEC_MAX_PARITY][SR_FEC_MAX_GROUP];
+pthread_once_t sr_gf_once = PTHREAD_ONCE_INIT;
+
+uint8_t sr_gf_mul(uint8_t a, uint8_t b) {
+    return a && b ? sr_gf_exp[sr_gf_log[a] + sr_gf_log[b]] : 0;
+}
+
+uint8_t sr_gf_inv(uint8_t a) {
+    return sr_gf_exp[255 - sr_gf_log[a]];
+}
+
+// products c * x for the low and the high nibble of x: c * x = lo[x & 15] ^ hi[x >> 4]
+void sr_gf_nibbles(uint8_t c, uint8_t lo[16], uint8_t hi[16]) {
+    for (int x = 0; x < 16; x++) {
+        lo[x] = sr_gf_mul(c, x);
+        hi[x] = sr_gf_mul(c, x << 4);
+    }
+}
+
+// dst ^= c * src, len bytes
+void sr_gf_muladd_table(uint8_t *dst, const uint8_t *src, uint8_t c, int len) {
+    uint8_t lo[16], hi[16];
+    sr_gf_nibbles(c, lo, hi);
+    for (int i = 0; i < len; i++) dst[i] ^= lo[src[i] & 15] ^ hi[src[i] >> 4];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// the two lookups as PSHUFB, 16 bytes at a time
+__attribute__((target("ssse3")))
+void sr_gf_muladd_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, int len) {
+    uint8_t lo[16], hi[16];
+    sr_gf_nibbles(c, lo, hi);
+    __m128i tlo = _mm_loadu_si128((const __m128i *)lo), thi = _mm_loadu_si128((const __m128i *)hi);
+    __m128i nib = _mm_set1_epi8(0x0f);
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(s, nib)),
+                                  _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(s, 4), nib)));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(dst + i)), p));
+    }
+    sr_gf_muladd_table(dst + i, src + i, c, len - i);
+}
+
+// and 32 bytes at a time (the tables repeated in both lanes)
+__attribute__((target("avx2")))
+void sr_gf_muladd_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, int len) {
+    uint8_t lo[16], hi[16];
+    sr_gf_nibbles(c, lo, hi);
+    __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+    __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+    __m256i nib = _mm256_set1_epi8(0x0f);
+    int i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(s, nib)),
+                                     _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(s, 4), nib)));
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(dst + i)), p));
+    }
+    sr_gf_muladd_table(dst + i, src + i, c, len - i);
+}
+#endif
+
+void (*sr_gf_muladd_fn)(uint8_t *dst, const uint8_t *src, uint8_t c, int len) = sr_gf_muladd_table;
+
+// tables, coefficients and the widest multiply the CPU runs; once per process (sr_fec_init)
+void sr_gf_init(void) {
+    for (int i = 0, x = 1; i < 255; i++) {
+        sr_gf_exp[i] = sr_gf_exp[i + 255] = x;
+        sr_gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) x ^= 0x11d;
+    }
+    for (int j = 0; j < SR_FEC_MAX_PARITY; j++) {
+        for (int i = 0; i < SR_FEC_MAX_GROUP; i++) {
+            uint8_t y = SR_FEC_MAX_PARITY + i;
+            sr_fec_coefs[j][i] = sr_gf_mul(y, sr_gf_inv(j ^ y));
+        }
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) sr_gf_muladd_fn = sr_gf_muladd_avx2;
+    else if (__builtin_cpu_supports("ssse3")) sr_gf_muladd_fn = sr_gf_muladd_ssse3;
+#endif
+}
+
+void sr_fec_init(void) {
+    pthread_once(&sr_gf_once, sr_gf_init);
+}
+
+// dst ^= c * src; c = 1 (all of parity 0) is a plain XOR, a word at a time
+void sr_gf_muladd(char *dst, const char *src, uint8_t c, int len) {
+    if (c != 1) {
+        if (c) sr_gf_muladd_fn((uint8_t *)dst, (const uint8_t *)src, c, len);
+        return;
+    }
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++) dst[i] ^= src[i];
+}
+
+// Invert the n x n matrix a (destroyed) into inv by Gauss-Jordan elimination; -1 if singular
+int sr_gf_invert(uint8_t a[][SR_FEC_MAX_PARITY], uint8_t inv[][SR_FEC_MAX_PARITY], int n) {
+    for (int r = 0; r < n; r++)
+        for (int k = 0; k < n; k++) inv[r][k] = r == k;
+    for (int c = 0; c < n; c++) {
+        int p = c;
+        while (p < n && !a[p][c]) p++;
+        if (p == n) return -1;
+        for (int k = 0; k < n; k++) {
+            uint8_t t = a[p][k]; a[p][k] = a[c][k]; a[c][k] = t;
+            t = inv[p][k]; inv[p][k] = inv[c][k]; inv[c][k] = t;
+        }
+        uint8_t f = sr_gf_inv(a[c][c]);
+        for (int k = 0; k < n; k++) {
+            a[c][k] = sr_gf_mul(a[c][k], f);
+            inv[c][k] = sr_gf_mul(inv[c][k], f);
+        }
+        for (int r = 0; r < n; r++) {
+            if (r == c || !(f = a[r][c])) continue;
+            for (int k = 0; k < n; k++) {
+                a[r][k] ^= sr_gf_mul(f, a[c][k]);
+                inv[r][k] ^= sr_gf_mul(f, inv[c][k]);
+            }
+        }
+    }
+    return 0;
+}
+
+// Parity packets for a group of n chunks at a loss rate of loss / 10000: the expected
+// losses plus one standard deviation (binomial, roughly sqrt of the mean), 1..SR_FEC_MAX_PARITY
+int sr_fec_parity_count(int loss, int n) {
+    double mean = loss / 10000.0 * n;
+    int k = 1;
+    while (k < SR_FEC_MAX_PARITY && (k < mean || (k - mean) * (k - mean) < mean)) k++;
+    return k;
+}
+
+// ---------- Receiver (Selective Repeat) ----------
+// Behavior:
+//   - expects to receive prior a "FILE_START <orig_filename> <total_chunks> <window> <bytes> <id> <stream> <origin>
+//     <end> <chunk> <fec> <mtime>" and answers it with a RESUME frame: where the sender has to start
+//   - seq 0 is file byte <origin>: a stripe (-P) covers total_chunks from there, up to <end>
+//   - all of the below is per session (see Sessions): packets find theirs by the sid in the header
+//   - allocates a ring of slots for the sender's window; chunk seq lives in slot seq & mask
+//   - stores incoming chunks (within window) to in-memory buffer and acknowledges them in
+//     delayed, coalesced SACK frames: one per -a in-order packets or -d usec after the first
+//     unacked one, whichever comes first; out-of-order, duplicate and last chunks, and any
+//     packet while a gap is open or as it fills one, get their SACK right after the current
+//     receive batch
+//   - whenever contiguous chunks starting at base exist, advance base past them (found with
+//     one bitmap scan; advancing base only clears bits, no payload is moved) and write them
+//     out once -W bytes have collected, in one pwritev()
+//   - records written chunks in <saved_filename>.ckpt; on restart resumes from the first chunk not on disk
+//     of the same file (same <bytes> and <mtime>), and deletes the checkpoint once every chunk is delivered
+//   - with -p there are no slots: chunks go to disk on arrival and only the bitmap is kept
+//   - with <fec> > 0 parity packets follow every group of that many chunks: a group's parity is
+//     kept while chunks of it are missing, and they are rebuilt (stored as if they had arrived)
+//     as soon as it holds as many parity packets as chunks missing
+//   - the file is finished as soon as its last chunk is delivered; FILE_END (sent once, unacknowledged)
+//     only covers transfers that have none, and a finished session still answers retransmissions
+
+typedef struct {
+    long first;                  // its first seq (-1: slot unused)
+    unsigned have;               // bit j: parity j is held
+    int len;                     // parity payload bytes (the group's longest chunk)
+    char *par;                   // SR_FEC_MAX_PARITY parity payloads of a chunk each
+} sr_fec_group_t;
+
+typedef struct {
+    long win;                    // packets accepted beyond base
+    int chunk;                   // payload bytes of a full packet (FILE_START's chunk)
+    long origin;                 // file offset of seq 0 (a stripe's range starts past 0)
+    long mask;                   // ring capacity - 1 (room for win + coalesce - 1 chunks)
+    long coalesce;               // delivered chunks held back for one write at most
+    char *data;                  // capacity * chunk: chunk seq at (seq & mask) * chunk (NULL with -p)
+    int *len;                    // bytes held in each slot
+    sr_bitmap_t present;         // slot holds a chunk not yet delivered (-p: received, not yet delivered)
+    long high;                   // highest seq stored so far (gap open while high >= base)
+    // delayed ACK state
+    int unacked;                 // data packets received since the last SACK
+    long ack_every;              // coalescing limit for this window
+    uint32_t ack_ts;             // ts of the oldest unacked packet (echoed, so RTT includes the delay)
+    uint32_t ack_due;            // sr_ts_usec() deadline for the pending SACK
+    int ack_now;                 // send the pending SACK once the current batch is processed
+    // -u: delivered chunks are written by WRITE SQEs straight from their slot
+    sr_uring_t *ring;
+    int index;                   // session pool slot, tags its WRITE SQEs
+    uint16_t stream;             // carried by its SACK frames
+    sr_bitmap_t writing;         // slot is the source of a write still in flight
+    int file_ops;                // writes in flight
+    long write_errors;
+    long writes;                 // stats: coalesced pwritev() calls
+    long file_size;              // -p: final size, once the last chunk has been seen (-1 before)
+    long end;                    // file offset past the range's last chunk (FILE_START's end)
+    long loss_holes, loss_span;  // seqs skipped by / passed over by each new highest seq (halved as they grow)
+    // -F: parity of the groups that miss chunks (see Forward error correction)
+    int fec_n;                   // chunks per group, 0: no parity comes
+    sr_fec_group_t *fec;         // SR_FEC_GROUPS, group g in slot g % SR_FEC_GROUPS (allocated on first parity)
+    char *fec_scratch;           // decoding: a syndrome per missing chunk, and one chunk read back from the file
+    long fec_parity, fec_rebuilt; // stats
+    long sacks_sent, data_pkts;  // stats
+} sr_rx_window_t;
+
+void sr_rx_window_free(sr_rx_window_t *rx) {
+    free(rx->data);
+    free(rx->len);
+    rx->data = NULL;
+    rx->len = NULL;
+    for (int i = 0; rx->fec && i < SR_FEC_GROUPS; i++) free(rx->fec[i].par);
+    free(rx->fec);
+    free(rx->fec_scratch);
+    rx->fec = NULL;
+    rx->fec_scratch = NULL;
+    rx->win = 0;
+    rx->unacked = 0;
+    rx->ack_now = 0;
+    bm_free(&rx->present);
+    bm_free(&rx->writing);
+}
+
+int sr_rx_window_alloc(sr_rx_window_t *rx, long win, int chunk) {
+    // -p writes on arrival: nothing is held back
+    long coalesce = sr_direct_write ? 1 : sr_write_coalesce / chunk;
+    long cap = sr_ring_capacity(win + coalesce - 1);
+    sr_rx_window_free(rx);
+    rx->coalesce = coalesce;
+    rx->win = win;
+    rx->chunk = chunk;
+    rx->mask = cap - 1;
+    rx->high = -1;
+    rx->unacked = 0;
+    rx->sacks_sent = rx->data_pkts = 0;
+    // never hold back more than half the window, or a small window would stall on the timer
+    rx->ack_every = sr_ack_every < win / 2 ? sr_ack_every : (win / 2 > 0 ? win / 2 : 1);
+    rx->write_errors = rx->writes = 0;
+    rx->file_size = -1;
+    rx->loss_holes = rx->loss_span = 0;
+    rx->fec_n = 0;
+    rx->fec_parity = rx->fec_rebuilt = 0;
+    if (!sr_direct_write) {
+        rx->data = malloc(cap * chunk);
+        rx->len = malloc(cap * sizeof(int));
+    }
+    if ((!sr_direct_write && (!rx->data || !rx->len)) || bm_init(&rx->present, cap) < 0 || bm_init(&rx->writing, cap) < 0) {
+        sr_rx_window_free(rx);
+        return -1;
+    }
+    return 0;
+}
+
+// -F: parity storage, once the first parity packet comes; 0 on success
+int sr_rx_fec_alloc(sr_rx_window_t *rx) {
+    sr_fec_init();
+    rx->fec = calloc(SR_FEC_GROUPS, sizeof(*rx->fec));
+    rx->fec_scratch = malloc((size_t)(SR_FEC_MAX_PARITY + 1) * rx->chunk);
+    if (!rx->fec || !rx->fec_scratch) {
+        free(rx->fec);
+        free(rx->fec_scratch);
+        rx->fec = NULL;
+        rx->fec_scratch = NULL;
+        return -1;
+    }
+    for (int i = 0; i < SR_FEC_GROUPS; i++) rx->fec[i].first = -1;
+    return 0;
+}
+
+// payload bytes of chunk seq (only the range's last one is short)
+int sr_rx_len(const sr_rx_window_t *rx, long seq) {
+    long left = rx->end - rx->origin - seq * rx->chunk;
+    return left < rx->chunk ? (int)left : rx->chunk;
+}
+
+// A new highest seq skipped the seqs between it and the previous one: count them
+// as lost (a late one is not taken back). Both counts halve once they span
+// SR_FEC_LOSS_SPAN, so the rate follows the last few thousand seqs.
+void sr_rx_loss(sr_rx_window_t *rx, long skipped) {
+    rx->loss_holes += skipped;
+    rx->loss_span += skipped + 1;
+    if (rx->loss_span < SR_FEC_LOSS_SPAN) return;
+    rx->loss_holes /= 2;
+    rx->loss_span /= 2;
+}
+
+// bytes held by the n slots from `slot` on (all full chunks but possibly the last)
+long sr_rx_run_bytes(const sr_rx_window_t *rx, long slot, long n) {
+    return (n - 1) * rx->chunk + rx->len[slot + n - 1];
+}
+
+// WRITE tag: first slot | slot count << SR_WR_BITS | session pool slot << 2 * SR_WR_BITS
+#define SR_WR_BITS 20
+#define SR_WR_MASK ((1L << SR_WR_BITS) - 1)
+
+// write completion; ctx: the windows by session pool slot
+void sr_rx_on_write(void *ctx, uint64_t val, int res) {
+    sr_rx_window_t *rx = ((sr_rx_window_t **)ctx)[val >> (2 * SR_WR_BITS)];
+    long slot = val & SR_WR_MASK, n = (val >> SR_WR_BITS) & SR_WR_MASK;
+    rx->file_ops--;
+    for (long i = 0; i < n; i++) bm_clear(&rx->writing, slot + i);
+    if (res != sr_rx_run_bytes(rx, slot, n)) rx->write_errors++;
+}
+
+// queue one write of the n chunks from seq on, which sit in consecutive slots
+void sr_rx_write(sr_rx_window_t *rx, int fd, long seq, long n) {
+    long slot = seq & rx->mask;
+    while (rx->file_ops >= SR_URING_FILE_DEPTH) sr_uring_wait(rx->ring, -1);
+    struct io_uring_sqe *sqe = sr_uring_sqe(rx->ring);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)(rx->data + slot * rx->chunk);
+    sqe->len = sr_rx_run_bytes(rx, slot, n);
+    sqe->off = (uint64_t)rx->origin + (uint64_t)seq * rx->chunk;
+    sqe->user_data = SR_OP_TAG(SR_OP_WRITE, slot | (uint64_t)n << SR_WR_BITS | (uint64_t)rx->index << (2 * SR_WR_BITS));
+    for (long i = 0; i < n; i++) bm_set(&rx->writing, slot + i);
+    rx->file_ops++;
+}
+
+// Write the delivered chunks [*written, base) still held in the window, as one
+// pwritev() of at most two iovecs (the run may wrap around the ring), or as WRITE
+// SQEs with -u; *written moves to base. With -p they are on disk already.
+void sr_rx_flush(sr_peer_t *peer, sr_rx_window_t *rx, int fd, long *written, long base) {
+    long seq = *written, n = base - seq;
+    *written = base;
+    if (n <= 0 || !rx->data) return;
+    long slot = seq & rx->mask, first = rx->mask + 1 - slot; // slots before the ring wraps
+    if (first > n) first = n;
+    if (rx->ring) {
+        sr_rx_write(rx, fd, seq, first);
+        if (n > first) sr_rx_write(rx, fd, seq + first, n - first);
+        return;
+    }
+    struct iovec iov[2] = {
+        { rx->data + slot * rx->chunk, sr_rx_run_bytes(rx, slot, first) },
+        { rx->data, n > first ? sr_rx_run_bytes(rx, 0, n - first) : 0 },
+    };
+    off_t off = rx->origin + (off_t)seq * rx->chunk;
+    size_t bytes = iov[0].iov_len + iov[1].iov_len;
+    struct iovec *v = iov;
+    int nv = n > first ? 2 : 1;
+    size_t left = bytes;
+    while (left > 0) {
+        ssize_t w = pwritev(fd, v, nv, off + (bytes - left));
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            rx->write_errors++;
+            log_event("%s ERROR: write of chunks %ld..%ld failed: %s", peer->tag, seq, base - 1, strerror(errno));
+            return;
+        }
+        left -= w;
+        // short write: skip what went out
+        while (nv > 0 && (size_t)w >= v->iov_len) {
+            w -= v->iov_len;
+            v++;
+            nv--;
+        }
+        if (nv > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+    rx->writes++;
+    if (sr_sync_writes) sync_file_range(fd, off, bytes, SYNC_FILE_RANGE_WRITE);
+}
+
+// wait for every queued write (before the file is closed or the window freed)
+void sr_rx_drain(sr_rx_window_t *rx) {
+    while (rx->ring && rx->file_ops) sr_uring_wait(rx->ring, -1);
+}
+
+// -p: reserve the whole file (a stripe: its range) up front, so out-of-order pwrite()s
+// never extend it piecemeal (and a full disk shows up at FILE_START rather than mid-transfer)
+void sr_rx_prealloc(sr_peer_t *peer, FILE *fp, long origin, long bytes) {
+    int err = bytes > 0 ? posix_fallocate(fileno(fp), origin, bytes) : 0;
+    if (err) log_event("%s preallocation failed (%s), the file grows as chunks arrive", peer->tag, strerror(err));
+}
+
+// cumulative ACK = base, plus the out-of-order chunks held in the rest of the window
+void sr_send_sack(sr_peer_t *peer, const sr_rx_window_t *rx, long base, uint32_t ts_echo) {
+    char frame[SACK_HDR_LEN + SACK_MAX_BITS / 8];
+    int loss = rx->loss_span ? (int)(rx->loss_holes * 10000 / rx->loss_span) : 0;
+    int flen = sr_sack_encode(frame, SACK_MAGIC, peer->sid, rx->stream, (uint32_t)base, ts_echo, loss, &rx->present,
+                              rx->mask, rx->win - 1);
+    sendto(peer->fd, frame, flen, 0, (struct sockaddr *)&peer->addr, peer->len);
+}
+
+// send the pending (coalesced) SACK now
+void sr_flush_sack(sr_peer_t *peer, sr_rx_window_t *rx, long base) {
+    sr_send_sack(peer, rx, base, rx->ack_ts);
+    rx->unacked = 0;
+    rx->ack_now = 0;
+    rx->sacks_sent++;
+}
+
+// ---------- Receiver sessions ----------
+// One per stream of a client (sid, stream): everything a transfer into this side
+// needs. Sessions live in a fixed pool so pointers stay put; the hash table maps
+// (sid, stream) -> pool slot + 1.
+typedef struct {
+    uint32_t sid;
+    uint16_t stream;
+    int index;                   // pool slot
+    char tag[48];                // "<thread tag>#<sid>/<stream>", prefix for its console and log lines
+    sr_peer_t peer;              // where its SACKs go: the address of its latest datagram
+    uint64_t last_seen;          // sr_now_usec() of its latest datagram
+    int pending;                 // on the pending-SACK list
+    FILE *fp;
+    char filename[512];
+    char saved_name[600];
+    long total_chunks;
+    long last_delivered;         // number of chunks already written to file (handed to the kernel)
+    long base;                   // next expected chunk index to deliver; [last_delivered, base) wait for a coalesced write
+    sr_rx_window_t rx;
+    sr_ckpt_t ckpt;
+    uint32_t xfer_id;            // id of the current transfer's FILE_START ...
+    char resume_frame[SACK_HDR_LEN + SACK_MAX_BITS / 8]; // ... and our answer to it
+    int resume_len;
+} sr_session_t;
+
+typedef struct {
+    sr_session_t *pool[SR_MAX_SESSIONS];
+    sr_rx_window_t *windows[SR_MAX_SESSIONS]; // by pool slot: routes WRITE completions
+    int slots[2 * SR_MAX_SESSIONS];           // open addressing, pool slot + 1 (0: empty)
+    int free_idx[SR_MAX_SESSIONS];            // unused pool slots
+    int nfree;
+    int count;
+    sr_session_t *pending[SR_MAX_SESSIONS];   // sessions holding back a SACK
+    int npending;
+    uint64_t swept_at;
+    long opened, evicted, refused;            // stats
+} sr_session_table_t;
+
+#define SR_SESSION_HMASK (2 * SR_MAX_SESSIONS - 1)
+
+int sr_session_hash(uint32_t sid, uint16_t stream) {
+    return (int)(((sid ^ (uint32_t)stream << 16) * 2654435761u) >> 8) & SR_SESSION_HMASK;
+}
+
+void sr_session_table_init(sr_session_table_t *t) {
+    memset(t, 0, sizeof(*t));
+    for (int i = 0; i < SR_MAX_SESSIONS; i++) t->free_idx[i] = SR_MAX_SESSIONS - 1 - i;
+    t->nfree = SR_MAX_SESSIONS;
+    t->swept_at = sr_now_usec();
+}
+
+// hash slot holding (sid, stream), or the empty slot where it would go
+int sr_session_probe(const sr_session_table_t *t, uint32_t sid, uint16_t stream) {
+    int h = sr_session_hash(sid, stream);
+    while (t->slots[h]) {
+        const sr_session_t *s = t->pool[t->slots[h] - 1];
+        if (s->sid == sid && s->stream == stream) break;
+        h = (h + 1) & SR_SESSION_HMASK;
+    }
+    return h;
+}
+
+sr_session_t *sr_session_find(sr_session_table_t *t, uint32_t sid, uint16_t stream) {
+    int h = sr_session_probe(t, sid, stream);
+    return t->slots[h] ? t->pool[t->slots[h] - 1] : NULL;
+}
+
+// the session for (sid, stream), created on first use; NULL when the table is full
+sr_session_t *sr_session_open(sr_session_table_t *t, const sr_peer_t *owner, uint32_t sid, uint16_t stream,
+                              const struct sockaddr_in *from) {
+    int h = sr_session_probe(t, sid, stream);
+    if (t->slots[h]) return t->pool[t->slots[h] - 1];
+    sr_session_t *s = t->nfree ? calloc(1, sizeof(*s)) : NULL;
+    if (!s) {
+        if (t->refused++ % 100 == 0)
+            log_event("%s REFUSED session %08x/%u: %d sessions open (%ld refused)", owner->tag, sid, stream, t->count,
+                      t->refused);
+        return NULL;
+    }
+    s->sid = sid;
+    s->stream = stream;
+    s->index = t->free_idx[--t->nfree];
+    snprintf(s->tag, sizeof(s->tag), "%s#%08x/%u", owner->tag, sid, stream);
+    s->peer = (sr_peer_t){ .tag = s->tag, .addr = *from, .len = sizeof(struct sockaddr_in), .sid = sid, .fd = owner->fd };
+    s->ckpt.fd = -1;
+    s->rx.index = s->index;
+    s->rx.stream = stream;
+    t->pool[s->index] = s;
+    t->windows[s->index] = &s->rx;
+    t->slots[h] = s->index + 1;
+    t->count++;
+    t->opened++;
+    log_event("%s SESSION open from %s:%d (%d open)", s->tag, inet_ntoa(from->sin_addr), ntohs(from->sin_port),
+              t->count);
+    return s;
+}
+
+// write out what the transfer delivered, then close its file and checkpoint
+void sr_session_close_file(sr_session_t *s) {
+    if (s->fp) sr_rx_flush(&s->peer, &s->rx, fileno(s->fp), &s->last_delivered, s->base);
+    sr_rx_drain(&s->rx);
+    sr_ckpt_mark_upto(&s->ckpt, s->last_delivered);
+    sr_ckpt_close(&s->ckpt, s->fp ? fileno(s->fp) : -1);
+    if (s->fp) fclose(s->fp);
+    s->fp = NULL;
+}
+
+void sr_session_evict(sr_session_table_t *t, sr_session_t *s) {
+    if (s->fp)
+        log_event("%s EVICT idle during '%s' (delivered=%ld, resumable)", s->tag, s->filename, s->last_delivered);
+    sr_session_close_file(s);
+    sr_rx_window_free(&s->rx);
+    for (int i = 0; i < t->npending; i++) {
+        if (t->pending[i] != s) continue;
+        t->pending[i] = t->pending[--t->npending];
+        break;
+    }
+    // backward-shift delete: pull later entries of the probe run into the hole
+    int hole = sr_session_probe(t, s->sid, s->stream);
+    for (int h = (hole + 1) & SR_SESSION_HMASK; t->slots[h]; h = (h + 1) & SR_SESSION_HMASK) {
+        const sr_session_t *o = t->pool[t->slots[h] - 1];
+        int want = sr_session_hash(o->sid, o->stream);
+        // entry at h may move to hole unless its home lies cyclically in (hole, h]
+        if (((h - want) & SR_SESSION_HMASK) < ((h - hole) & SR_SESSION_HMASK)) continue;
+        t->slots[hole] = t->slots[h];
+        hole = h;
+    }
+    t->slots[hole] = 0;
+    t->pool[s->index] = NULL;
+    t->windows[s->index] = NULL;
+    t->free_idx[t->nfree++] = s->index;
+    t->count--;
+    t->evicted++;
+    free(s);
+}
+
+// evict the sessions silent for longer than -I; at most once per SR_SESSION_SWEEP_USEC
+void sr_session_sweep(sr_session_table_t *t, uint64_t now) {
+    if (now - t->swept_at < SR_SESSION_SWEEP_USEC) return;
+    t->swept_at = now;
+    uint64_t idle = (uint64_t)sr_session_idle * 1000000;
+    for (int i = 0; i < SR_MAX_SESSIONS; i++) {
+        sr_session_t *s = t->pool[i];
+        if (s && now - s->last_seen > idle) sr_session_evict(t, s);
+    }
+}
+
+// the session holds back a SACK: make sure the batch-end pass looks at it
+void sr_session_want_ack(sr_session_table_t *t, sr_session_t *s) {
+    if (s->pending) return;
+    s->pending = 1;
+    t->pending[t->npending++] = s;
+}
+
+// Batch done: send the SACKs it asked for and those whose delay ran out.
+// Returns the usec until the next held-back one is due, -1 if none is held.
+int64_t sr_session_acks(sr_session_table_t *t) {
+    int64_t wait = -1;
+    uint32_t now = sr_ts_usec();
+    for (int i = 0; i < t->npending;) {
+        sr_session_t *s = t->pending[i];
+        sr_rx_window_t *rx = &s->rx;
+        int32_t left = rx->ack_now ? 0 : (int32_t)(rx->ack_due - now);
+        if (rx->unacked && left > 0) {
+            if (wait < 0 || left < wait) wait = left;
+            i++;
+            continue;
+        }
+        if (rx->unacked) sr_flush_sack(&s->peer, rx, s->base);
+        s->pending = 0;
+        t->pending[i] = t->pending[--t->npending];
+    }
+    return wait;
+}
+
+// The transfer is complete (FILE_END, or its last chunk delivered: FILE_END is
+// sent once and may be lost): close and finalize the file, free the window.
+void sr_session_finish(sr_session_table_t *t, sr_session_t *s, const sr_rbatch_t *rb) {
+    sr_rx_window_t *rx = &s->rx;
+    if (s->fp) sr_rx_flush(&s->peer, rx, fileno(s->fp), &s->last_delivered, s->base);
+    sr_rx_drain(rx);
+    if (s->fp) {
+        // -p: drop the preallocated tail past the last chunk
+        if (sr_direct_write && rx->file_size >= 0 && ftruncate(fileno(s->fp), rx->file_size) < 0)
+            log_event("%s ERROR: cannot trim '%s': %s", s->tag, s->saved_name, strerror(errno));
+        sr_ckpt_mark_upto(&s->ckpt, s->last_delivered);
+        log_event("%s CKPT flushes=%ld resume_point=%ld%s", s->tag, s->ckpt.flushes, s->ckpt.base,
+                  s->ckpt.base >= s->total_chunks ? " (complete, removed)" : "");
+        if (s->ckpt.base >= s->total_chunks) sr_ckpt_remove(&s->ckpt, fileno(s->fp));
+        else sr_ckpt_close(&s->ckpt, fileno(s->fp));
+        fclose(s->fp);
+        s->fp = NULL;
+    }
+    log_event("%s END receiving '%s' (delivered=%ld data_pkts=%ld sacks=%ld)",
+              s->tag, s->filename, s->last_delivered, rx->data_pkts, rx->sacks_sent);
+    if (rx->fec_n)
+        log_event("%s FEC parity=%ld rebuilt=%ld (%d chunks per group)", s->tag, rx->fec_parity, rx->fec_rebuilt,
+                  rx->fec_n);
+    if (rx->ring)
+        log_event("%s URING enters=%ld write_errors=%ld", s->tag, rx->ring->enters, rx->write_errors);
+    else if (sr_direct_write)
+        log_event("%s DIRECT file_size=%ld write_errors=%ld", s->tag, rx->file_size, rx->write_errors);
+    else
+        log_event("%s WRITES calls=%ld write_errors=%ld (up to %ld chunks each)", s->tag,
+                  rx->writes, rx->write_errors, rx->coalesce);
+    sr_batch_report(&s->peer, "recv", rb->calls, rb->pkts);
+    log_event("%s SESSIONS open=%d opened=%ld evicted=%ld refused=%ld", s->tag, t->count,
+              t->opened, t->evicted, t->refused);
+    sr_rx_window_free(rx);
+    printf("\n[%s] Finished receiving '%s' (chunks delivered=%ld)\n", s->tag, s->filename, s->last_delivered);
+}
+
+// one more packet for the pending SACK, which echoes the oldest unacked packet's ts
+void sr_session_unacked(sr_session_table_t *t, sr_session_t *s, uint32_t ts) {
+    sr_rx_window_t *rx = &s->rx;
+    if (rx->unacked++ == 0) {
+        rx->ack_ts = ts;
+        rx->ack_due = sr_ts_usec() + (uint32_t)sr_ack_delay_usec;
+    }
+    sr_session_want_ack(t, s);
+}
+
+// keep chunk seq (in the window, not held yet): in its slot, or with -p straight at its place in the file
+void sr_session_store(sr_session_t *s, long seq, const char *payload, int len, int last) {
+    sr_rx_window_t *rx = &s->rx;
+    long idx = seq & rx->mask; // ring slot for this seq
+    if (sr_direct_write) {
+        // straight to its place in the file; the window only remembers that it came
+        off_t off = rx->origin + (off_t)seq * rx->chunk;
+        if (s->fp && pwrite(fileno(s->fp), payload, len, off) != (ssize_t)len) rx->write_errors++;
+        else sr_ckpt_mark(&s->ckpt, seq);
+        if (last && rx->file_size < 0) rx->file_size = off + len; // FILE_START had no size
+    } else {
+        while (bm_test(&rx->writing, idx)) sr_uring_wait(rx->ring, -1); // slot still being written out
+        memcpy(rx->data + idx * rx->chunk, payload, len);
+        rx->len[idx] = len;
+    }
+    bm_set(&rx->present, idx);
+    if (seq > rx->high) rx->high = seq;
+}
+
+// Deliver the contiguous run at base, write out and checkpoint what is due, and send
+// or schedule the SACK (at once if ack_now). May finish the transfer.
+void sr_session_deliver(sr_session_table_t *t, sr_session_t *s, const sr_rbatch_t *rb, int ack_now) {
+    sr_rx_window_t *rx = &s->rx;
+    long window_start = s->base;
+    // deliver the contiguous run starting at base: first clear bit ends it
+    long end = sr_ring_scan(&rx->present, rx->mask, s->base, s->base + rx->win, 0);
+    for (; s->base < end; s->base++) bm_clear(&rx->present, s->base & rx->mask);
+    if (end > window_start) {
+        // the delivered chunks stay in their slots until a full write's worth has collected
+        if (s->fp && s->base - s->last_delivered >= rx->coalesce) {
+            sr_rx_flush(&s->peer, rx, fileno(s->fp), &s->last_delivered, s->base);
+            sr_ckpt_mark_upto(&s->ckpt, s->last_delivered);
+        }
+        if (s->fp && sr_ckpt_due(&s->ckpt, sr_now_usec())) {
+            // persist the resume point: only what has actually reached the file
+            sr_rx_drain(rx);
+            sr_ckpt_flush(&s->ckpt, fileno(s->fp));
+        }
+        log_event("%s Delivered up to chunk %ld", s->tag, s->base);
+    }
+    // a gap still open, or a gap just filled: ACK at once
+    if (rx->high >= s->base || end > window_start + 1) ack_now = 1;
+    if (s->base >= s->total_chunks) {
+        // all of it is here: acknowledge and finish without waiting for FILE_END
+        sr_flush_sack(&s->peer, rx, s->base);
+        sr_session_finish(t, s, rb);
+    } else if (rx->unacked >= rx->ack_every) sr_flush_sack(&s->peer, rx, s->base);
+    else if (ack_now) rx->ack_now = 1; // one SACK after the batch covers every packet in it
+}
+
+// A chunk of a group that did arrive, wherever it is by now: in its slot while it
+// waits for delivery or its write, otherwise (always with -p) read back into buf.
+// NULL if it cannot be read.
+const char *sr_session_chunk(sr_session_t *s, long seq, char *buf, int *len) {
+    sr_rx_window_t *rx = &s->rx;
+    if (rx->data && seq >= s->last_delivered) {
+        *len = rx->len[seq & rx->mask];
+        return rx->data + (seq & rx->mask) * rx->chunk;
+    }
+    *len = sr_rx_len(rx, seq);
+    sr_rx_drain(rx); // -u: its write may still be in flight
+    if (!s->fp || pread(fileno(s->fp), buf, *len, rx->origin + (off_t)seq * rx->chunk) != *len) return NULL;
+    return buf;
+}
+
+// -F: rebuild the chunks the group at `first` misses if it holds as much parity as
+// that; returns how many were stored. A group that misses nothing lets its parity go.
+int sr_session_fec(sr_session_t *s, long first) {
+    sr_rx_window_t *rx = &s->rx;
+    int n = rx->fec_n;
+    sr_fec_group_t *g = &rx->fec[(first / n) % SR_FEC_GROUPS];
+    if (g->first != first) return 0;
+    long m = s->total_chunks - first < n ? s->total_chunks - first : n;
+    int miss[SR_FEC_MAX_PARITY], rows[SR_FEC_MAX_PARITY], e = 0, r = 0;
+    for (int i = 0; i < m; i++) {
+        long seq = first + i;
+        if (seq < s->base || bm_test(&rx->present, seq & rx->mask)) continue;
+        if (e == SR_FEC_MAX_PARITY || seq >= s->base + rx->win) return 0; // more than parity can cover, or no slot yet
+        miss[e++] = i;
+    }
+    if (!e) {
+        g->first = -1;
+        return 0;
+    }
+    for (int j = 0; j < SR_FEC_MAX_PARITY && r < e; j++)
+        if (g->have >> j & 1) rows[r++] = j;
+    if (r < e) return 0; // wait for more parity (or the retransmissions)
+
+    // syndromes: each parity minus what the chunks that did arrive contribute to it
+    char *syn = rx->fec_scratch, *tmp = syn + (size_t)e * rx->chunk;
+    for (r = 0; r < e; r++) memcpy(syn + (size_t)r * rx->chunk, g->par + (size_t)rows[r] * rx->chunk, g->len);
+    for (int i = 0, k = 0; i < m; i++) {
+        if (k < e && miss[k] == i) {
+            k++;
+            continue;
+        }
+        int len;
+        const char *d = sr_session_chunk(s, first + i, tmp, &len);
+        if (!d) return 0;
+        for (r = 0; r < e; r++) sr_gf_muladd(syn + (size_t)r * rx->chunk, d, sr_fec_coefs[rows[r]][i], len);
+    }
+    // what is left is the missing chunks times the matrix of their coefficients: invert it
+    uint8_t a[SR_FEC_MAX_PARITY][SR_FEC_MAX_PARITY], inv[SR_FEC_MAX_PARITY][SR_FEC_MAX_PARITY];
+    for (r = 0; r < e; r++)
+        for (int k = 0; k < e; k++) a[r][k] = sr_fec_coefs[rows[r]][miss[k]];
+    if (sr_gf_invert(a, inv, e) < 0) return 0;
+    for (int k = 0; k < e; k++) {
+        long seq = first + miss[k];
+        memset(tmp, 0, g->len);
+        for (r = 0; r < e; r++) sr_gf_muladd(tmp, syn + (size_t)r * rx->chunk, inv[k][r], g->len);
+        sr_session_store(s, seq, tmp, sr_rx_len(rx, seq), seq == s->total_chunks - 1);
+        log_event("%s FEC rebuilt seq=%ld from %d parity packets", s->tag, seq, e);
+    }
+    rx->fec_rebuilt += e;
+    g->first = -1;
+    return e;
+}
+
+// -F: parity packet j of the group at `first`: keep it while the group misses chunks
+// and rebuild them once there is enough of it
+void sr_session_parity(sr_session_table_t *t, sr_session_t *s, const sr_rbatch_t *rb, long first, int j,
+                       const char *payload, int len, uint32_t ts) {
+    sr_rx_window_t *rx = &s->rx;
+    int n = rx->fec_n;
+    if (!n || first % n || first >= s->total_chunks || j >= SR_FEC_MAX_PARITY) return;
+    rx->fec_parity++;
+    if (first + n <= s->base) return; // the group is complete and delivered
+    if (!rx->fec && sr_rx_fec_alloc(rx) < 0) return;
+    sr_fec_group_t *g = &rx->fec[(first / n) % SR_FEC_GROUPS];
+    if (!g->par && !(g->par = malloc((size_t)SR_FEC_MAX_PARITY * rx->chunk))) return;
+    if (g->first != first) { // an older group's parity gives way: its holes are retransmitted
+        g->first = first;
+        g->have = 0;
+    }
+    memcpy(g->par + (size_t)j * rx->chunk, payload, len);
+    g->len = len;
+    g->have |= 1u << j;
+    if (!sr_session_fec(s, first)) return;
+    sr_session_unacked(t, s, ts);
+    sr_session_deliver(t, s, rb, 1);
+}
+
+// One socket's receiving side: its batch, ring and sessions. The receiver thread
+// and the reactor (-E) both feed it datagrams and call its tick when a batch is done.
+typedef struct {
+    sr_peer_t *peer;             // socket and tag; hellos through it may move the sender (learn)
+    sr_rbatch_t rb;
+    sr_uring_t ring, *ur;
+    sr_session_table_t *sessions;
+} sr_receiver_t;
+
+void sr_receiver_close(sr_receiver_t *r) {
+    if (r->ur) {
+        sr_rbatch_detach(&r->rb);
+        sr_uring_free(r->ur);
+        r->ur = NULL;
+    }
+    free(r->sessions);
+    r->sessions = NULL;
+    sr_rbatch_free(&r->rb);
+}
+
+// use_ring: may run on io_uring (-u); the reactor reads the socket itself
+int sr_receiver_open(sr_receiver_t *r, sr_peer_t *peer, int use_ring) {
+    memset(r, 0, sizeof(*r));
+    r->peer = peer;
+    if (sr_rbatch_alloc(&r->rb, sr_batch, sr_gso_segs > 0) < 0) {
+        perror("batch alloc");
+        return -1;
+    }
+    if (sr_gso_segs && sr_enable_gro(peer->fd) < 0)
+        log_event("%s UDP_GRO not available (%s), receiving one datagram per packet", peer->tag, strerror(errno));
+    // the default buffer holds only a few datagrams of a large chunk (the kernel caps it at rmem_max)
+    int rcvbuf = SR_SOCK_RCVBUF;
+    setsockopt(peer->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    r->sessions = malloc(sizeof(*r->sessions));
+    if (!r->sessions) {
+        perror("session table alloc");
+        sr_receiver_close(r);
+        return -1;
+    }
+    sr_session_table_init(r->sessions);
+    r->ur = use_ring ? sr_uring_open(&r->ring, peer->tag) : NULL;
+    if (r->ur) {
+        sr_rbatch_attach(&r->rb, r->ur, peer->fd);
+        sr_uring_on(r->ur, SR_OP_WRITE, sr_rx_on_write, r->sessions->windows);
+    }
+    return 0;
+}
+
+// Batch done: send the SACKs it asked for and evict idle sessions. Returns the usec
+// until the next held-back SACK or sweep is due, -1 if nothing is.
+int64_t sr_receiver_tick(sr_receiver_t *r) {
+    int64_t wait = sr_session_acks(r->sessions);
+    if (wait == 0) return 0;
+    if (r->sessions->count) {
+        uint64_t now = sr_now_usec();
+        sr_session_sweep(r->sessions, now);
+        int64_t sweep = (int64_t)(r->sessions->swept_at + SR_SESSION_SWEEP_USEC - now);
+        if (sweep < 0) sweep = 0;
+        if (wait < 0 || sweep < wait) wait = sweep;
+    }
+    return wait;
+}
+
+// one datagram (text message or data packet) from `from`
+void sr_receiver_packet(sr_receiver_t *r, char *buf, int n, const struct sockaddr_in *from) {
+    if (n < SID_LEN) return;
+    // every datagram starts with its session id
+    uint32_t sid_net;
+    memcpy(&sid_net, buf, 4);
+    uint32_t sid = ntohl(sid_net);
+
+    // Attempt to parse text header messages first
+    buf[n] = '\0';
+    char *text = buf + SID_LEN;
+    if (strncmp(text, HELLO_MSG, strlen(HELLO_MSG)) == 0) {
+        // the server's sender talks to the latest client, through the socket it came in on
+        if (r->peer->learn) {
+            r->peer->learn->addr = *from;
+            r->peer->learn->sid = sid;
+            r->peer->learn->fd = r->peer->fd;
+        }
+        log_event("%s hello from %s:%d (session %08x)", r->peer->tag, inet_ntoa(from->sin_addr), ntohs(from->sin_port), sid);
+        return;
+    }
+    if (strncmp(text, FILE_START_MSG, strlen(FILE_START_MSG)) == 0) {
+        // format: FILE_START <orig_name> <total_chunks> <window> <bytes> <id> <stream> <origin> <end> <chunk> <fec> <mtime>
+        // (padded with NULs to a full data packet: it probes the path for the sender)
+        char orig[512];
+        long total_chunks = 0, win = SR_DEFAULT_WINDOW, bytes = -1, origin = 0, end = -1, chunk = CHUNK_SIZE;
+        unsigned id = 0, stream = 0;
+        int fec = 0;
+        long long mtime = 0;
+        if (sscanf(text + strlen(FILE_START_MSG), "%511s %ld %ld %ld %u %u %ld %ld %ld %d %lld", orig, &total_chunks, &win,
+                   &bytes, &id, &stream, &origin, &end, &chunk, &fec, &mtime) < 1)
+            return;
+        if (origin < 0) origin = 0;
+        if (fec < 0 || fec > SR_FEC_MAX_GROUP) fec = 0;
+        if (win < 1 || win > SR_MAX_WINDOW) win = SR_DEFAULT_WINDOW;
+        if (chunk < 1 || chunk > SR_MAX_CHUNK || win * chunk > SR_MAX_WINDOW_BYTES) {
+            log_event("%s ERROR: FILE_START for '%s' with chunk size %ld (window %ld) refused", r->peer->tag, orig, chunk, win);
+            return;
+        }
+        if (end < origin) end = origin + total_chunks * chunk; // the range's last chunk may be short
+        if (bytes >= 0 && end > bytes) end = bytes;
+        // a stripe: other sessions write the rest of the file at the same time
+        int stripe = origin > 0 || (bytes >= 0 && end < bytes);
+        sr_session_t *s = sr_session_open(r->sessions, r->peer, sid, (uint16_t)stream, from);
+        if (!s) return;
+        s->peer.addr = *from;
+        s->last_seen = sr_now_usec();
+        if (id && id == s->xfer_id && !strcmp(orig, s->filename)) {
+            // our answer got lost (or this is a duplicate): repeat it, reset nothing
+            sendto(s->peer.fd, s->resume_frame, s->resume_len, 0, (struct sockaddr *)&s->peer.addr, s->peer.len);
+            return;
+        }
+
+        // a previous transfer that never saw FILE_END: write out what it delivered
+        sr_session_close_file(s);
+        s->total_chunks = total_chunks;
+        snprintf(s->filename, sizeof(s->filename), "%s", orig);
+        snprintf(s->saved_name, sizeof(s->saved_name), "received_%s", s->filename);
+
+        char ckpt_name[640];
+        if (stripe) // a journal per range: "<received file>.<origin>-<end>.ckpt" (byte offsets)
+            snprintf(ckpt_name, sizeof(ckpt_name), "%s.%ld-%ld.ckpt", s->saved_name, origin, end);
+        else
+            snprintf(ckpt_name, sizeof(ckpt_name), "%s.ckpt", s->saved_name);
+        s->last_delivered = sr_ckpt_open(&s->ckpt, ckpt_name, total_chunks, chunk, bytes, mtime, &s->peer); // chunks already on disk
+        s->base = s->last_delivered;
+        // open file - keep its contents if resuming (every write goes to an explicit offset),
+        // but nothing past what the checkpoint vouches for: an earlier file's tail would stay
+        // (-p keeps the chunks past base it marked, stripes the other stripes' ranges)
+        s->fp = s->last_delivered ? fopen(s->saved_name, "r+b") : NULL;
+        if (s->fp && !stripe && !sr_direct_write) {
+            long keep = s->last_delivered * chunk; // the last chunk may be short
+            struct stat st;
+            if (bytes >= 0 && keep > bytes) keep = bytes;
+            if (fstat(fileno(s->fp), &st) == 0 && st.st_size > keep && ftruncate(fileno(s->fp), keep) < 0)
+                log_event("%s ERROR: cannot trim '%s' to its resume point: %s", s->tag, s->saved_name, strerror(errno));
+        }
+        if (!s->fp && stripe) {
+            // never truncate what the other stripes wrote: only cut the file to its final size
+            int fd = open(s->saved_name, O_RDWR | O_CREAT, 0644);
+            if (fd >= 0 && !(s->fp = fdopen(fd, "r+b"))) close(fd);
+        }
+        if (!s->fp) s->fp = fopen(s->saved_name, "w+b"); // -F reads chunks back to rebuild others
+        if (s->fp && stripe && bytes >= 0 && ftruncate(fileno(s->fp), bytes) < 0)
+            log_event("%s ERROR: cannot size '%s': %s", s->tag, s->saved_name, strerror(errno));
+        if (!s->fp) {
+            perror("fopen receive");
+            log_event("%s ERROR: cannot open '%s' for writing", s->tag, s->saved_name);
+            sr_ckpt_close(&s->ckpt, -1);
+            return;
+        }
+        // fresh, empty window sized to the sender's
+        sr_rx_window_t *rx = &s->rx;
+        if (sr_rx_window_alloc(rx, win, chunk) < 0) {
+            perror("window alloc");
+            sr_session_close_file(s);
+            return;
+        }
+        rx->ring = r->ur;
+        rx->origin = origin;
+        rx->end = end;
+        rx->fec_n = fec;
+        if (sr_direct_write) {
+            sr_rx_prealloc(&s->peer, s->fp, origin, end - origin);
+            if (bytes >= 0) rx->file_size = bytes;
+            // chunks past base that are on disk already count as received: the sender skips them
+            for (long q = s->base + 1; q < s->base + rx->win && q < total_chunks; q++) {
+                if (!sr_ckpt_test(&s->ckpt, q)) continue;
+                bm_set(&rx->present, q & rx->mask);
+                rx->high = q;
+            }
+        }
+        // tell the sender where to start
+        s->xfer_id = id;
+        s->resume_len = sr_sack_encode(s->resume_frame, RESUME_MAGIC, sid, s->stream, (uint32_t)s->base, id, 0,
+                                       &rx->present, rx->mask, rx->win - 1);
+        sendto(s->peer.fd, s->resume_frame, s->resume_len, 0, (struct sockaddr *)&s->peer.addr, s->peer.len);
+
+        if (r->sessions->count == 1) r->rb.calls = r->rb.pkts = 0;
+        log_event("%s START receiving '%s' total_chunks=%ld resume_from=%ld window=%ld chunk=%ld fec=%d",
+                  s->tag, s->filename, total_chunks, s->last_delivered, win, chunk, fec);
+        if (stripe)
+            log_event("%s STRIPE bytes %ld..%ld of %ld", s->tag, origin, end - 1, bytes);
+        printf("\n[%s] Receiving '%s' -> saved as '%s' (resume from chunk %ld, window %ld)\n",
+               s->tag, s->filename, s->saved_name, s->last_delivered, win);
+        return;
+    }
+    if (strncmp(text, FILE_END_MSG, strlen(FILE_END_MSG)) == 0) {
+        unsigned stream = 0;
+        sscanf(text + strlen(FILE_END_MSG), "%u", &stream);
+        sr_session_t *s = sr_session_find(r->sessions, sid, (uint16_t)stream);
+        if (!s || !s->rx.win) return; // unknown, or this transfer is finished already
+        s->last_seen = sr_now_usec();
+        sr_session_finish(r->sessions, s, &r->rb);
+        return;
+    }
+
+    // Otherwise process binary header + data: expect at least HDR_LEN bytes
+    if (n < HDR_LEN) return;
+    // extract header
+    uint16_t stream_net;
+    memcpy(&stream_net, buf+4, 2);
+    uint32_t seq_net;
+    memcpy(&seq_net, buf+6, 4);
+    uint32_t len_net;
+    memcpy(&len_net, buf+10, 4);
+    uint8_t flags = (uint8_t)buf[14];
+    uint32_t ts_net;
+    memcpy(&ts_net, buf+15, 4);
+    uint16_t stream = ntohs(stream_net);
+    uint32_t seq = ntohl(seq_net);
+    uint32_t len = ntohl(len_net);
+    uint32_t ts = ntohl(ts_net);
+    // safety
+    if (len > SR_MAX_CHUNK || len > (uint32_t)(n - HDR_LEN)) return;
+    // the session it belongs to (opened by its FILE_START)
+    sr_session_t *s = sr_session_find(r->sessions, sid, stream);
+    if (!s) return;
+    s->peer.addr = *from;
+    s->last_seen = sr_now_usec();
+    if (!s->rx.win) {
+        // finished already: our last SACK got lost, the sender is still retransmitting
+        if (s->total_chunks && s->base >= s->total_chunks) {
+            char frame[SACK_HDR_LEN];
+            int flen = sr_sack_encode(frame, SACK_MAGIC, s->sid, s->stream, (uint32_t)s->base, ts, 0, NULL, 0, 0);
+            sendto(s->peer.fd, frame, flen, 0, (struct sockaddr *)&s->peer.addr, s->peer.len);
+        }
+        return;
+    }
+    sr_rx_window_t *rx = &s->rx;
+    if (len > (uint32_t)rx->chunk) return; // larger than the chunk FILE_START announced
+    // pointer to payload
+    char *payload = buf + HDR_LEN;
+    if (flags & SR_FLAG_PARITY) {
+        sr_session_parity(r->sessions, s, &r->rb, seq, flags >> 2, payload, len, ts);
+        return;
+    }
+
+    // Compute window range
+    long window_start = s->base;
+    long window_end = window_start + rx->win - 1;
+
+    // coalesce: the pending SACK echoes the oldest unacked packet's ts
+    rx->data_pkts++;
+    sr_session_unacked(r->sessions, s, ts);
+    int ack_now = (flags & 1); // last chunk: don't make the sender wait for the timer
+
+    // If seq is within current window, store and SACK
+    if ((long)seq >= window_start && (long)seq <= window_end) {
+        long idx = seq & rx->mask; // ring slot for this seq
+        // store data if not already stored
+        if (!bm_test(&rx->present, idx)) {
+            long prev = rx->high >= s->base ? rx->high : s->base - 1; // highest seq seen (or its stand-in)
+            if ((long)seq > prev) sr_rx_loss(rx, seq - prev - 1);
+            sr_session_store(s, seq, payload, len, flags & 1);
+            log_event("%s RECV pkt seq=%u len=%u (stored idx=%ld window_start=%ld)", s->tag, seq, len, idx, window_start);
+            // -F: the group's parity may have come first
+            if (rx->fec) sr_session_fec(s, seq - seq % rx->fec_n);
+        } else {
+            // duplicate -- already present
+            log_event("%s RECV duplicate pkt seq=%u (ignored store)", s->tag, seq);
+            ack_now = 1;
+        }
+        // out of order (seq past base): ACK at once
+        sr_session_deliver(r->sessions, s, &r->rb, ack_now || (long)seq != window_start);
+    } else {
+        // Out-of-window packet:
+        // If it's less than base (already delivered), resend SACK: its cum_ack covers seq (sender missed ack)
+        if ((long)seq < window_start) {
+            rx->ack_now = 1;
+            log_event("%s RECV out-of-window seq=%u (< base=%ld), resent SACK", s->tag, seq, window_start);
+        } else {
+            // seq > window_end: ignore or optionally send NACK/ACK for highest in-order
+            log_event("%s RECV pkt seq=%u outside window [%ld..%ld], ignored", s->tag, seq, window_start, window_end);
+        }
+    }
+}
+
+// ---------- Dispatcher (threaded mode) ----------
+// The receiver and the sender thread share their socket, and both used to read it:
+// a SACK could land in the receiver and a data packet in the sender, each dropped
+// there, so a transfer in each direction at once ran into spurious timeouts. Now
+// one dispatcher thread per socket is its only reader. It sorts each datagram with
+// sr_is_frame and copies it into one of two single-producer single-consumer rings:
+// data and text for the receiver thread, SACK/RESUME frames for the sender thread.
+// The rings are lock-free (head and tail are atomics on their own cache lines); a
+// consumer about to sleep raises `waiting` and blocks on the ring's eventfd, which
+// the dispatcher only writes when it sees that flag after publishing a batch. A
+// full ring drops the datagram, as a full socket buffer would.
+// Datagrams range from a SACK to a 64 KB data packet, so the slots only point into
+// a byte ring of their own (`bytes`): each one is stored contiguously, from where
+// the previous one ended or else from the start, and the slot at the consumer's
+// head tells the producer where the bytes still in use begin.
+typedef struct {
+    int n;
+    struct sockaddr_in from;
+    char *buf;                   // n + 1 bytes: the receiver NUL-terminates text in place
+} sr_qpkt_t;
+
+typedef struct {
+    sr_qpkt_t *slots;
+    unsigned mask;
+    char *bytes;
+    size_t size;                 // of bytes
+    size_t put;                  // producer: where the next datagram goes if it fits
+    unsigned head __attribute__((aligned(64)));  // next slot to read (consumer)
+    unsigned tail __attribute__((aligned(64)));  // slots published (producer)
+    unsigned fill;               // producer: slots filled, published at the next sr_pktq_flush
+    unsigned head_seen;          // producer: consumer's head as last read
+    int waiting __attribute__((aligned(64)));    // consumer is (about to be) blocked on efd
+    int efd;
+    long drops;                  // producer: datagrams the ring had no room for
+} sr_pktq_t;
+
+// a ring zeroed by calloc may be freed without having been initialised
+void sr_pktq_free(sr_pktq_t *q) {
+    free(q->slots);
+    free(q->bytes);
+    if (q->efd > 0) close(q->efd);
+    memset(q, 0, sizeof(*q));
+}
+
+int sr_pktq_init(sr_pktq_t *q, unsigned cap, size_t size) {
+    memset(q, 0, sizeof(*q));
+    q->mask = cap - 1;
+    q->size = size;
+    q->slots = malloc((size_t)cap * sizeof(*q->slots));
+    q->bytes = malloc(size);
+    q->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return q->slots && q->bytes && q->efd >= 0 ? 0 : -1;
+}
+
+// the bytes in use run from the oldest slot's buffer to q->put, possibly wrapping;
+// 1 if n more fit at q->put (or at the start, where q->put then moves)
+int sr_pktq_room(sr_pktq_t *q, size_t n) {
+    if (q->fill == q->head_seen) {
+        q->put = 0;               // empty: start over
+        return n <= q->size;
+    }
+    size_t used = q->slots[q->head_seen & q->mask].buf - q->bytes;
+    if (q->put > used) {
+        // in use: [used, put); free: [put, size) and [0, used)
+        if (q->put + n <= q->size) return 1;
+        if (n >= used) return 0;  // never let put catch up with used: that would read as empty
+        q->put = 0;
+        return 1;
+    }
+    return q->put + n < used;     // wrapped: free is [put, used)
+}
+
+// producer: the slot to fill next, with n + 1 bytes at its buf; NULL if the ring is full
+sr_qpkt_t *sr_pktq_slot(sr_pktq_t *q, int n) {
+    if (q->fill - q->head_seen > q->mask || !sr_pktq_room(q, n + 1)) {
+        q->head_seen = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (q->fill - q->head_seen > q->mask || !sr_pktq_room(q, n + 1)) return NULL;
+    }
+    sr_qpkt_t *p = &q->slots[q->fill & q->mask];
+    p->buf = q->bytes + q->put;
+    q->put += n + 1;
+    return p;
+}
+
+// producer: the slot from sr_pktq_slot is filled in
+void sr_pktq_put(sr_pktq_t *q) {
+    q->fill++;
+}
+
+// producer: publish what was put and wake the consumer if it sleeps
+void sr_pktq_flush(sr_pktq_t *q) {
+    if (q->fill == q->tail) return;
+    __atomic_store_n(&q->tail, q->fill, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // tail before waiting; pairs with sr_pktq_wait
+    if (__atomic_load_n(&q->waiting, __ATOMIC_RELAXED) && __atomic_exchange_n(&q->waiting, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(q->efd, &one, sizeof(one)) < 0) { /* counter saturated: it is readable anyway */ }
+    }
+}
+
+// consumer: the oldest datagram, NULL if the ring is empty
+sr_qpkt_t *sr_pktq_peek(sr_pktq_t *q) {
+    if (q->head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &q->slots[q->head & q->mask];
+}
+
+// consumer: done with the datagram from sr_pktq_peek
+void sr_pktq_pop(sr_pktq_t *q) {
+    __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
+// consumer: wait until the ring has a datagram or timeout_usec passes (< 0: no
+// timeout); returns 1 if it has one
+int sr_pktq_wait(sr_pktq_t *q, int64_t timeout_usec) {
+    __atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // waiting before tail; pairs with sr_pktq_flush
+    if (q->head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) && timeout_usec != 0)
+        sr_wait_readable(q->efd, timeout_usec);
+    __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+    uint64_t v;
+    if (read(q->efd, &v, sizeof(v)) < 0) { /* no wakeup pending */ }
+    return q->head != __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
+
+typedef struct {
+    sr_peer_t *peer;             // for the tag of log lines
+    int fd;                      // the socket it reads (peer->fd at start: a server's peer may move on)
+    sr_rbatch_t rb;
+    sr_uring_t ring, *ur;        // -u: the socket's receives run on the dispatcher's ring
+    sr_pktq_t data, acks;
+    pthread_t thread;
+} sr_dispatch_t;
+
+sr_dispatch_t *sr_dispatchers[SR_MAX_WORKERS]; // set up before the engine threads start, read-only after
+int sr_ndispatchers = 0;
+
+// the dispatcher reading socket fd, NULL if it has none
+sr_dispatch_t *sr_dispatch_find(int fd) {
+    for (int i = 0; i < sr_ndispatchers; i++)
+        if (sr_dispatchers[i]->fd == fd) return sr_dispatchers[i];
+    return NULL;
+}
+
+// copy one datagram into q
+void sr_dispatch_put(sr_dispatch_t *d, sr_pktq_t *q, const char *what, const char *buf, int n,
+                     const struct sockaddr_in *from) {
+    sr_qpkt_t *p = n <= MAX_PKT ? sr_pktq_slot(q, n) : NULL;
+    if (!p) {
+        q->drops++;
+        if (!(q->drops & (q->drops - 1))) // 1, 2, 4, ...: the log shows an overflow without flooding
+            log_event("%s DISPATCH %s ring full, %ld datagrams dropped so far", d->peer->tag, what, q->drops);
+        return;
+    }
+    memcpy(p->buf, buf, n);
+    p->n = n;
+    p->from = *from;
+    sr_pktq_put(q);
+}
+
+void *dispatch_thread(void *arg) {
+    sr_dispatch_t *d = arg;
+    for (;;) {
+        char *buf;
+        int n;
+        struct sockaddr_in from;
+        if (sr_rbatch_recv(&d->rb, d->fd, MSG_WAITFORONE) <= 0) continue;
+        while (sr_rbatch_next(&d->rb, &buf, &n, &from)) {
+            if (sr_is_frame(buf, n))
+                sr_dispatch_put(d, &d->acks, "ack", buf, n, &from);
+            else
+                sr_dispatch_put(d, &d->data, "data", buf, n, &from);
+        }
+        // one release store (and at most one wakeup) per ring per batch
+        sr_pktq_flush(&d->data);
+        sr_pktq_flush(&d->acks);
+    }
+    return NULL;
+}
+
+void sr_dispatch_free(sr_dispatch_t *d) {
+    if (d->ur) {
+        sr_rbatch_detach(&d->rb);
+        sr_uring_free(d->ur); // cancels the posted receives
+    }
+    sr_rbatch_free(&d->rb);
+    sr_pktq_free(&d->data);
+    sr_pktq_free(&d->acks);
+    free(d);
+}
+
+// Start a dispatcher for each of the n sockets of peers[]. A socket left without
+// one (no memory, no thread) keeps being read by its receiver and sender threads.
+void sr_dispatch_start(sr_peer_t *peers, int n) {
+    for (int i = 0; i < n; i++) {
+        sr_dispatch_t *d = calloc(1, sizeof(*d));
+        if (!d) {
+            perror("dispatcher alloc");
+            continue;
+        }
+        d->peer = &peers[i];
+        d->fd = peers[i].fd;
+        if (sr_pktq_init(&d->data, SR_DISPATCH_QUEUE, SR_DISPATCH_BYTES) < 0 ||
+            sr_pktq_init(&d->acks, SR_DISPATCH_ACKS, SR_DISPATCH_ACK_BYTES) < 0 ||
+            sr_rbatch_alloc(&d->rb, sr_batch, sr_gso_segs > 0) < 0) {
+            log_event("%s ERROR: no dispatcher (%s), the threads share the socket", peers[i].tag, strerror(errno));
+            sr_dispatch_free(d);
+            continue;
+        }
+        d->ur = sr_uring_open(&d->ring, peers[i].tag);
+        if (d->ur) sr_rbatch_attach(&d->rb, d->ur, d->fd);
+        if (pthread_create(&d->thread, NULL, dispatch_thread, d) != 0) {
+            log_event("%s ERROR: no dispatcher thread, the threads share the socket", peers[i].tag);
+            sr_dispatch_free(d);
+            continue;
+        }
+        sr_dispatchers[sr_ndispatchers++] = d;
+    }
+}
+
+void *receiver_thread(void *arg) {
+    sr_peer_t *peer = arg;
+    sr_dispatch_t *d = sr_dispatch_find(peer->fd);
+    sr_receiver_t r;
+    // with a dispatcher it owns the socket (and the -u ring for it): this thread only consumes
+    if (sr_receiver_open(&r, peer, !d) < 0) return NULL;
+
+    while (d) {
+        // a batch worth of datagrams from the dispatcher, then the SACKs they asked for
+        sr_qpkt_t *p;
+        int k = 0;
+        while (k < sr_batch && (p = sr_pktq_peek(&d->data))) {
+            sr_receiver_packet(&r, p->buf, p->n, &p->from);
+            sr_pktq_pop(&d->data);
+            k++;
+        }
+        if (k) {
+            r.rb.calls++;
+            r.rb.pkts += k;
+        }
+        int64_t wait = sr_receiver_tick(&r);
+        if (k == sr_batch || wait == 0) continue;
+        sr_pktq_wait(&d->data, wait);
+    }
+
+    for (;;) {
+        char *buf;
+        int n;
+        struct sockaddr_in from;
+        if (!sr_rbatch_next(&r.rb, &buf, &n, &from)) {
+            // batch done: send the SACKs it asked for; if some are only being held back,
+            // send them when due and otherwise wait for data at most that long
+            int64_t wait = sr_receiver_tick(&r);
+            if (wait == 0) continue;
+            if (wait >= 0 && sr_rbatch_wait(&r.rb, peer->fd, wait) <= 0) continue; // timer fired
+            // receive the next batch of packets or text (blocks for the first one only)
+            sr_rbatch_recv(&r.rb, peer->fd, MSG_WAITFORONE);
+            continue;
+        }
+        sr_receiver_packet(&r, buf, n, &from);
+    }
+    sr_receiver_close(&r);
+    return NULL;
+}
+
+// ---------- Sender (Selective Repeat) ----------
+// Sender keeps a heap ring of slots holding seq = base .. base+W-1 (W = sr_window),
+// chunk seq lives in slot seq & mask so sliding the window never moves payload
+// (with -m a slot holds no payload at all, only a pointer into the file mapping).
+// Per-slot sent/acked flags are bitmaps: the slide is one scan for the first unacked seq.
+// New chunks go out in seq order while the packets in flight fit min(cwnd, window);
+// every transmission arms a deadline in a min-heap, and the
+// sender sleeps in ppoll() until the earliest deadline or an ACK, so timeout handling costs
+// O(expired) rather than a sweep of the window.
+// Resume: the receiver's RESUME answer to FILE_START sets base and lists chunks it already
+// has past base; those count as acked without being sent (sr_tx_skip_held).
+
+typedef struct {
+    long seq;                 // absolute sequence number
+    int len;                  // payload length
+    uint64_t sent_at;         // sr_now_usec of the latest transmission
+    uint64_t due;             // its retransmission deadline
+    long delivered;           // link->delivered / delivered_at when it was sent (delivery rate)
+    uint64_t delivered_at;
+    char *data;               // payload: a chunk-sized slice of tx->buf, or of the file mapping (-m)
+    char hdr[HDR_LEN];        // -z: header of the latest transmission, sent in place
+    uint32_t zc_end;          // -z: data and hdr are pinned until zerocopy id zc_end - 1 completes
+} send_slot_t;
+
+// ---------- Retransmission timers ----------
+// Binary min-heap of (deadline, seq). Entries are never removed early: an ACK or a
+// retransmission just makes the old entry stale, and stale entries are dropped when
+// they reach the top (their deadline no longer matches the slot's).
+typedef struct {
+    uint64_t due;
+    long seq;
+} sr_timer_t;
+
+typedef struct {
+    sr_timer_t *h;
+    long n, cap;
+} sr_timer_heap_t;
+
+int sr_timer_push(sr_timer_heap_t *t, uint64_t due, long seq) {
+    if (t->n == t->cap) {
+        long cap = t->cap ? t->cap * 2 : 256;
+        sr_timer_t *h = realloc(t->h, cap * sizeof(sr_timer_t));
+        if (!h) return -1;
+        t->h = h;
+        t->cap = cap;
+    }
+    long i = t->n++;
+    while (i > 0 && t->h[(i - 1) / 2].due > due) {
+        t->h[i] = t->h[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    t->h[i].due = due;
+    t->h[i].seq = seq;
+    return 0;
+}
+
+void sr_timer_pop(sr_timer_heap_t *t) {
+    sr_timer_t last = t->h[--t->n];
+    long i = 0;
+    for (;;) {
+        long c = 2 * i + 1;
+        if (c >= t->n) break;
+        if (c + 1 < t->n && t->h[c + 1].due < t->h[c].due) c++;
+        if (t->h[c].due >= last.due) break;
+        t->h[i] = t->h[c];
+        i = c;
+    }
+    if (t->n) t->h[i] = last;
+}
+
+void sr_timer_free(sr_timer_heap_t *t) {
+    free(t->h);
+    memset(t, 0, sizeof(*t));
+}
+
+#define SR_REC_FAST 1      // fast retransmit: cwnd is frozen until the hole is repaired
+#define SR_REC_RTO 2       // after a timeout: slow start again, no further cut
+
+// ---------- Shared path state ----------
+// Every stream of a session goes over the same path, so they share one congestion
+// controller: a stream may send a new chunk only while the packets in flight on all
+// of them stay below cwnd. Delivery-rate bookkeeping and the pacing schedule are
+// shared with it; loss recovery, RTT and timers stay per stream (own seq space).
+struct sr_tx;
+
+typedef struct {
+    sr_cc_t cc;
+    long delivered;           // packets acked so far, on any stream (delivery rate)
+    uint64_t delivered_at;    // when `delivered` last grew
+    uint64_t pace_next;       // paced sending: earliest time for the next new chunk
+    uint64_t cut_at;          // latest loss/timeout reaction of cc ...
+    const struct sr_tx *cut_by; // ... and the stream that caused it
+    struct sr_tx *members[SR_MAX_STREAMS];
+    int n;
+} sr_link_t;
+
+// State of one outgoing transfer (stream)
+typedef struct sr_tx {
+    sr_link_t *link;          // path shared with the session's other streams
+    uint16_t stream;
+    long win;                 // packets in flight at most
+    long mask;                // ring capacity - 1
+    send_slot_t *slots;       // heap, capacity entries
+    sr_bitmap_t acked;
+    sr_bitmap_t retx;         // retransmitted at least once (Karn's rule)
+    sr_rtt_t rtt;
+    sr_timer_heap_t timers;
+    uint64_t backoff_at;      // when the RTO was last doubled
+    long base_seq;            // first unacked seq
+    long send_next;           // first seq never sent
+    long next_seq;            // first seq not loaded into the window
+    long sacked;              // acked bits set in [base_seq, send_next)
+    long high_sacked;         // highest seq ever SACKed
+    int in_recovery;          // SR_REC_FAST / SR_REC_RTO until base_seq reaches recover
+    long recover;             // send_next when the loss was detected
+    sr_sbatch_t out;          // transmissions queued for the next sendmmsg
+    // -u: chunks are loaded by READ SQEs; next_seq only advances over completed reads
+    sr_uring_t *ring;
+    sr_bitmap_t loaded;       // read completed, not yet counted into next_seq
+    long read_next;           // first seq with no read issued
+    int file_ops;             // reads in flight
+    char *buf;                // payload of every slot, when the file is read rather than mapped
+    char *map;                // -m: the whole file, read-only
+    size_t map_len;
+    long total_chunks;
+    int chunk;                // payload bytes per packet (only the range's last chunk is shorter)
+    long origin, end;         // file bytes it sends (-P: this stripe's range); seq 0 starts at origin
+    FILE *fp;
+    // chunks the receiver already has (RESUME bitmap): bit i -> seq held_from + i
+    uint8_t *held;
+    long held_from, held_bits;
+    long skipped;             // of them, counted as acked without being sent
+    // -F: parity of the group being sent (see Forward error correction)
+    int fec_n;                // chunks per group, 0: no parity
+    int fec_k;                // parity packets the current group gets
+    int fec_len;              // its longest chunk so far
+    long fec_next;            // next seq to fold into it (-1: a chunk was skipped, the group gets no parity)
+    int fec_loss;             // the receiver's loss estimate (1/10000) from its latest SACK
+    char *fec_par;            // SR_FEC_MAX_PARITY parity payloads of a chunk each
+    char fec_hdr[SR_FEC_MAX_PARITY][HDR_LEN]; // -z: sent in place
+    uint32_t fec_zc_end;      // -z: parity and headers pinned until zerocopy id fec_zc_end - 1 completes
+    long fec_groups, fec_sent; // stats
+} sr_tx_t;
+
+void sr_tx_free(sr_tx_t *tx) {
+    free(tx->slots);
+    tx->slots = NULL;
+    free(tx->buf);
+    tx->buf = NULL;
+    if (tx->map) munmap(tx->map, tx->map_len);
+    tx->map = NULL;
+    bm_free(&tx->acked);
+    bm_free(&tx->retx);
+    bm_free(&tx->loaded);
+    free(tx->held);
+    tx->held = NULL;
+    free(tx->fec_par);
+    tx->fec_par = NULL;
+    sr_timer_free(&tx->timers);
+    sr_sbatch_free(&tx->out);
+}
+
+int sr_tx_alloc(sr_tx_t *tx, long win) {
+    long cap = sr_ring_capacity(win);
+    memset(tx, 0, sizeof(*tx));
+    tx->win = win;
+    tx->mask = cap - 1;
+    tx->high_sacked = -1;
+    sr_rtt_init(&tx->rtt);
+    tx->slots = calloc(cap, sizeof(send_slot_t));
+    if (!tx->slots || bm_init(&tx->acked, cap) < 0 || bm_init(&tx->retx, cap) < 0 || bm_init(&tx->loaded, cap) < 0 ||
+        sr_sbatch_alloc(&tx->out, sr_batch, sr_gso_segs ? sr_gso_segs : 1) < 0) {
+        sr_tx_free(tx);
+        return -1;
+    }
+    return 0;
+}
+
+// Where payload comes from once the file is open: its mapping with -m, otherwise a
+// buffer of one chunk per slot that sr_tx_fill reads into. 0 on success.
+int sr_tx_source(sr_peer_t *peer, sr_tx_t *tx, long filesize) {
+    if (sr_use_mmap && filesize > 0) {
+        void *m = mmap(NULL, filesize, PROT_READ, MAP_SHARED, fileno(tx->fp), 0);
+        if (m != MAP_FAILED) {
+            madvise(m, filesize, MADV_SEQUENTIAL);
+            tx->map = m;
+            tx->map_len = filesize;
+            return 0;
+        }
+        log_event("%s mmap failed (%s), reading the file instead", peer->tag, strerror(errno));
+    }
+    long cap = tx->mask + 1;
+    tx->buf = malloc(cap * tx->chunk);
+    if (!tx->buf) return -1;
+    for (long i = 0; i < cap; i++) tx->slots[i].data = tx->buf + i * tx->chunk;
+    return 0;
+}
+
+// Cut the range into chunks of `chunk` bytes: at open, or smaller while nothing is
+// loaded yet (the path MTU turned out lower), slot buffers included.
+void sr_tx_chunk(sr_tx_t *tx, int chunk) {
+    tx->chunk = chunk;
+    tx->total_chunks = (tx->end - tx->origin + chunk - 1) / chunk;
+    for (long i = 0; tx->buf && i <= tx->mask; i++) tx->slots[i].data = tx->buf + i * chunk;
+}
+
+// payload bytes of chunk seq
+int sr_tx_len(const sr_tx_t *tx, long seq) {
+    long left = tx->end - tx->origin - seq * tx->chunk;
+    return left < tx->chunk ? (int)left : tx->chunk;
+}
+
+void sr_tx_on_read(void *ctx, uint64_t seq, int res) {
+    sr_tx_t *tx = ctx;
+    long i = seq & tx->mask;
+    send_slot_t *slot = &tx->slots[i];
+    tx->file_ops--;
+    if (res < 0) {
+        log_event("read of chunk %lu failed: %s", (unsigned long)seq, strerror(-res));
+        res = 0;
+    }
+    slot->seq = seq;
+    slot->len = res;
+    bm_clear(&tx->acked, i);
+    bm_clear(&tx->retx, i);
+    bm_set(&tx->loaded, i);
+    // reads may complete out of order: the window grows over the contiguous run
+    while (tx->next_seq < tx->read_next && bm_test(&tx->loaded, tx->next_seq & tx->mask)) {
+        bm_clear(&tx->loaded, tx->next_seq & tx->mask);
+        tx->next_seq++;
+    }
+}
+
+// (re)fill free slots: window covers [base_seq, base_seq + win)
+void sr_tx_fill(sr_tx_t *tx) {
+    if (tx->map) {
+        // nothing to read: the slot just points at the chunk's bytes in the mapping
+        while (tx->next_seq < tx->total_chunks && tx->next_seq < tx->base_seq + tx->win) {
+            long i = tx->next_seq & tx->mask;
+            send_slot_t *slot = &tx->slots[i];
+            slot->seq = tx->next_seq;
+            slot->data = tx->map + tx->origin + (size_t)tx->next_seq * tx->chunk;
+            slot->len = sr_tx_len(tx, tx->next_seq);
+            bm_clear(&tx->acked, i);
+            bm_clear(&tx->retx, i);
+            tx->next_seq++;
+        }
+        return;
+    }
+    if (tx->ring) {
+        // queue reads; they are submitted with the pass's sends or wait and land while we wait
+        while (tx->read_next < tx->total_chunks && tx->read_next < tx->base_seq + tx->win &&
+               tx->file_ops < SR_URING_FILE_DEPTH) {
+            struct io_uring_sqe *sqe = sr_uring_sqe(tx->ring);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fileno(tx->fp);
+            sqe->addr = (uintptr_t)tx->slots[tx->read_next & tx->mask].data;
+            sqe->len = sr_tx_len(tx, tx->read_next);
+            sqe->off = (uint64_t)tx->origin + (uint64_t)tx->read_next * tx->chunk;
+            sqe->user_data = SR_OP_TAG(SR_OP_READ, tx->read_next);
+            tx->read_next++;
+            tx->file_ops++;
+        }
+        return;
+    }
+    while (tx->next_seq < tx->total_chunks && tx->next_seq < tx->base_seq + tx->win) {
+        long i = tx->next_seq & tx->mask;
+        send_slot_t *slot = &tx->slots[i];
+        if (tx->out.zc) sr_sbatch_zc_wait(&tx->out, slot->zc_end); // kernel may still be sending the old chunk
+        int bytes = fread(slot->data, 1, sr_tx_len(tx, tx->next_seq), tx->fp);
+        if (bytes <= 0) break;
+        slot->seq = tx->next_seq;
+        slot->len = bytes;
+        bm_clear(&tx->acked, i);
+        bm_clear(&tx->retx, i);
+        tx->next_seq++;
+    }
+}
+
+// packets sent and neither acked nor SACKed
+long sr_tx_pipe(const sr_tx_t *tx) {
+    return tx->send_next - tx->base_seq - tx->sacked;
+}
+
+// packets in flight on every stream of the path
+long sr_link_pipe(const sr_link_t *l) {
+    long pipe = 0;
+    for (int i = 0; i < l->n; i++) pipe += sr_tx_pipe(l->members[i]);
+    return pipe;
+}
+
+// tx starts sending over l. A path nothing was sent over restarts from scratch
+// (slow start), as a lone transfer always did; cwnd never outgrows the sum of
+// the members' windows.
+void sr_link_join(sr_link_t *l, sr_tx_t *tx) {
+    if (!l->n) {
+        memset(l, 0, sizeof(*l));
+        sr_cc_init(&l->cc, sr_cc_find(sr_cc_name), tx->win);
+    } else {
+        l->cc.rwnd += tx->win;
+    }
+    l->members[l->n++] = tx;
+    tx->link = l;
+}
+
+void sr_link_leave(sr_link_t *l, sr_tx_t *tx) {
+    for (int i = 0; i < l->n; i++) {
+        if (l->members[i] != tx) continue;
+        l->members[i] = l->members[--l->n];
+        if (l->n) {
+            l->cc.rwnd -= tx->win;
+            sr_cc_clamp(&l->cc);
+        }
+        break;
+    }
+}
+
+// A loss or timeout on tx: 1 if cc should react, 0 if another stream's reaction
+// less than a round trip ago covers it (one congestion event, seen by several streams).
+int sr_link_cut(sr_link_t *l, const sr_tx_t *tx, uint64_t now) {
+    if (l->cut_at && l->cut_by != tx && now - l->cut_at < (uint64_t)tx->rtt.srtt) return 0;
+    l->cut_at = now;
+    l->cut_by = tx;
+    return 1;
+}
+
+// the packet header (see Packet header layout)
+void sr_tx_header(char *hdr, const sr_peer_t *peer, const sr_tx_t *tx, long seq, int len, uint8_t flags, uint64_t now) {
+    uint32_t sid_net = htonl(peer->sid);
+    uint16_t stream_net = htons(tx->stream);
+    uint32_t seq_net = htonl((uint32_t)seq);
+    uint32_t len_net = htonl((uint32_t)len);
+    uint32_t ts_net = htonl((uint32_t)now);
+    memcpy(hdr, &sid_net, 4);
+    memcpy(hdr+4, &stream_net, 2);
+    memcpy(hdr+6, &seq_net, 4);
+    memcpy(hdr+10, &len_net, 4);
+    memcpy(hdr+14, &flags, 1);
+    memcpy(hdr+15, &ts_net, 4);
+}
+
+// queue (re)transmission of one window slot and arm its retransmission deadline;
+// the packet leaves with the next sr_sbatch_flush (or when the batch fills up)
+void sr_tx_transmit(sr_peer_t *peer, sr_tx_t *tx, long seq, uint64_t now) {
+    long i = seq & tx->mask;
+    send_slot_t *slot = &tx->slots[i];
+
+    // build the 19 byte header; the payload is sent straight from the slot
+    char hdr_buf[HDR_LEN], *hdr = hdr_buf;
+    if (tx->out.zc) {
+        sr_sbatch_zc_wait(&tx->out, slot->zc_end); // the previous send may still reference it
+        hdr = slot->hdr;
+    }
+    uint8_t flags = (slot->seq == tx->total_chunks-1) ? 1 : 0; // last chunk flag
+    sr_tx_header(hdr, peer, tx, slot->seq, slot->len, flags, now);
+    sr_sbatch_add(peer, &tx->out, hdr, slot->data, slot->len);
+    slot->zc_end = tx->out.zc_sent + tx->out.n; // upper bound: this message's id + 1
+
+    // nothing in flight: an idle gap must not count as delivery time
+    sr_link_t *l = tx->link;
+    if (sr_link_pipe(l) <= 1) l->delivered_at = now;
+    slot->delivered = l->delivered;
+    slot->delivered_at = l->delivered_at;
+    slot->sent_at = now;
+    slot->due = now + tx->rtt.rto;
+    sr_timer_push(&tx->timers, slot->due, seq);
+    log_event("%s SENT seq=%ld len=%d (slot=%ld)", peer->tag, slot->seq, slot->len, i);
+    printf("[%s] Sent seq=%ld (slot=%ld len=%d)\n", peer->tag, slot->seq, i, slot->len);
+}
+
+int sr_tx_held(const sr_tx_t *tx, long seq) {
+    long i = seq - tx->held_from;
+    return i >= 0 && i < tx->held_bits && (tx->held[i >> 3] >> (i & 7) & 1);
+}
+
+// first transmissions of chunks the receiver already has are skipped: they are
+// acked right away, and the window slides over them
+void sr_tx_skip_held(sr_tx_t *tx) {
+    if (!tx->held_bits) return;
+    while (tx->send_next < tx->next_seq && sr_tx_held(tx, tx->send_next)) {
+        bm_set(&tx->acked, tx->send_next & tx->mask);
+        tx->sacked++;
+        tx->skipped++;
+        tx->send_next++;
+    }
+    long slid = sr_ring_scan(&tx->acked, tx->mask, tx->base_seq, tx->send_next, 0);
+    tx->sacked -= slid - tx->base_seq;
+    tx->base_seq = slid;
+}
+
+// -F: the group at `first` is complete: its parity goes out right behind it (flushed
+// with it, as the next group is folded into the same buffers)
+void sr_tx_fec_send(sr_peer_t *peer, sr_tx_t *tx, long first, uint64_t now) {
+    for (int j = 0; j < tx->fec_k; j++) {
+        sr_tx_header(tx->fec_hdr[j], peer, tx, first, tx->fec_len, SR_FLAG_PARITY | j << 2, now);
+        sr_sbatch_add(peer, &tx->out, tx->fec_hdr[j], tx->fec_par + (size_t)j * tx->chunk, tx->fec_len);
+    }
+    tx->fec_zc_end = tx->out.zc_sent + tx->out.n;
+    sr_sbatch_flush(&tx->out);
+    tx->fec_groups++;
+    tx->fec_sent += tx->fec_k;
+    log_event("%s FEC parity group=%ld k=%d len=%d (loss %.2f%%)", peer->tag, first, tx->fec_k, tx->fec_len,
+              tx->fec_loss / 100.0);
+}
+
+// -F: fold chunk seq, just sent for the first time, into its group's parity. Each
+// group picks its parity count from the receiver's loss rate when it starts; one
+// that did not go out whole (resumed in its middle, held chunks skipped) gets none.
+void sr_tx_fec(sr_peer_t *peer, sr_tx_t *tx, long seq, uint64_t now) {
+    int n = tx->fec_n, i = seq % n;
+    if (i == 0) {
+        if (tx->out.zc) sr_sbatch_zc_wait(&tx->out, tx->fec_zc_end); // the last group's parity may be pinned still
+        tx->fec_k = sr_fec_parity_count(tx->fec_loss, n);
+        tx->fec_len = 0;
+        tx->fec_next = seq;
+        memset(tx->fec_par, 0, (size_t)tx->fec_k * tx->chunk);
+    }
+    if (seq != tx->fec_next) {
+        tx->fec_next = -1;
+        return;
+    }
+    const send_slot_t *slot = &tx->slots[seq & tx->mask];
+    for (int j = 0; j < tx->fec_k; j++)
+        sr_gf_muladd(tx->fec_par + (size_t)j * tx->chunk, slot->data, sr_fec_coefs[j][i], slot->len);
+    if (slot->len > tx->fec_len) tx->fec_len = slot->len;
+    tx->fec_next++;
+    if (i == n - 1 || seq == tx->total_chunks - 1) sr_tx_fec_send(peer, tx, seq - i, now);
+}
+
+// The last seq a SACK must reach past before chunk seq is presumed lost: seq itself,
+// or with -F the end of its group, whose parity may still rebuild it (not for the
+// transfer's last group, which nothing follows)
+long sr_tx_loss_edge(const sr_tx_t *tx, long seq) {
+    if (!tx->fec_n) return seq;
+    long end = seq - seq % tx->fec_n + tx->fec_n - 1;
+    return end < tx->total_chunks - 1 ? end : seq;
+}
+
+// pacing gate for the next new chunk of any stream: 1 (and the schedule advanced) if it may go now
+int sr_link_paced(sr_link_t *l, uint64_t now) {
+    if (l->cc.pacing_rate <= 0) return 1;
+    if (l->pace_next + SR_PACE_SLACK_USEC < now) l->pace_next = now - SR_PACE_SLACK_USEC; // no credit for idle time
+    if (l->pace_next > now) return 0;
+    l->pace_next += (uint64_t)(1e6 / l->cc.pacing_rate);
+    return 1;
+}
+
+// how long the sender may sleep: until the earliest retransmission deadline or, if a
+// new chunk is held back only by pacing, its send time (-1: nothing scheduled)
+int64_t sr_tx_next_wait(const sr_tx_t *tx, uint64_t now) {
+    int64_t wait = -1;
+    if (tx->timers.n) {
+        wait = (int64_t)(tx->timers.h[0].due - now);
+        if (wait < 0) wait = 0;
+    }
+    const sr_link_t *l = tx->link;
+    if (l->cc.pacing_rate > 0 && tx->send_next < tx->next_seq && sr_link_pipe(l) < sr_cc_window(&l->cc)) {
+        int64_t p = (int64_t)(l->pace_next - now);
+        if (p < 0) p = 0;
+        if (wait < 0 || p < wait) wait = p;
+    }
+    return wait;
+}
+
+void sr_tx_retransmit(sr_peer_t *peer, sr_tx_t *tx, long seq, uint64_t now) {
+    bm_set(&tx->retx, seq & tx->mask);
+    tx->rtt.retransmits++;
+    sr_tx_transmit(peer, tx, seq, now);
+}
+
+// Pop every deadline that has passed; resend the chunks that are still unacked.
+// The RTO doubles once per loss episode: only a packet sent at or after the previous
+// backoff can trigger the next one, so a burst of expiries counts once. The same
+// episode is the timeout the congestion controller sees.
+// Returns how many were retransmitted.
+int sr_tx_expire(sr_peer_t *peer, sr_tx_t *tx, uint64_t now) {
+    int resent = 0, backoff = 0;
+    while (tx->timers.n && tx->timers.h[0].due <= now) {
+        sr_timer_t t = tx->timers.h[0];
+        sr_timer_pop(&tx->timers);
+        long i = t.seq & tx->mask;
+        // stale: already acked, slid out of the window, or rearmed by a later transmission
+        if (t.seq < tx->base_seq || t.seq >= tx->send_next || bm_test(&tx->acked, i) ||
+            tx->slots[i].seq != t.seq || tx->slots[i].due != t.due) continue;
+        if (tx->slots[i].sent_at >= tx->backoff_at) backoff = 1;
+        sr_tx_retransmit(peer, tx, t.seq, now);
+        resent++;
+    }
+    if (backoff) {
+        sr_cc_t *cc = &tx->link->cc;
+        sr_rtt_backoff(&tx->rtt);
+        tx->backoff_at = now;
+        if (sr_link_cut(tx->link, tx, now)) cc->ops->on_timeout(cc, now);
+        cc->timeouts++;
+        tx->in_recovery = SR_REC_RTO;
+        tx->recover = tx->send_next;
+        log_event("%s TIMEOUT stream=%u cwnd=%.1f ssthresh=%.1f rto=%ldus", peer->tag, tx->stream, cc->cwnd, cc->ssthresh,
+                  tx->rtt.rto);
+    }
+    return resent;
+}
+
+// Apply one SACK frame; returns 1 if base_seq moved
+int sr_tx_on_sack(sr_peer_t *peer, sr_tx_t *tx, const char *buf, int n) {
+    sr_sack_t sk;
+    if (sr_sack_decode(buf, n, SACK_MAGIC, &sk) < 0 || sk.sid != peer->sid || sk.stream != tx->stream)
+        return 0; // another session's or stream's
+    log_event("%s RECV SACK stream=%u cum=%u sack_bits=%d loss=%d", peer->tag, sk.stream, sk.cum_ack, sk.nbits, sk.loss);
+    sr_link_t *l = tx->link;
+    tx->fec_loss = sk.loss;
+
+    long old_base = tx->base_seq;
+    // cumulative part: everything below cum_ack is delivered
+    long cum = sk.cum_ack < (uint32_t)tx->send_next ? (long)sk.cum_ack : tx->send_next;
+    long newly_acked = 0;
+    int acked_retx = 0;
+    long newest = -1;             // acked seq sent last: its send-time stamps give the rate sample
+    if (cum > tx->base_seq) {
+        // Karn: did the cumulative part cover a retransmitted, not yet acked chunk?
+        for (long r = sr_ring_scan(&tx->retx, tx->mask, tx->base_seq, cum, 1); r < cum;
+             r = sr_ring_scan(&tx->retx, tx->mask, r + 1, cum, 1)) {
+            if (!bm_test(&tx->acked, r & tx->mask)) { acked_retx = 1; break; }
+        }
+        long held = sr_ring_count(&tx->acked, tx->mask, tx->base_seq, cum); // SACKed earlier
+        newly_acked += cum - tx->base_seq - held;
+        tx->sacked -= held;
+        tx->base_seq = cum;
+        newest = cum - 1;
+    }
+    // selective part: walk the set bits a byte at a time
+    for (int b = 0; b < (sk.nbits + 7) / 8; b++) {
+        for (unsigned v = sk.bits[b]; v; v &= v - 1) {
+            long s = (long)sk.cum_ack + 1 + b * 8 + __builtin_ctz(v);
+            if (s < tx->base_seq || s >= tx->send_next || bm_test(&tx->acked, s & tx->mask)) continue;
+            bm_set(&tx->acked, s & tx->mask);
+            newly_acked++;
+            tx->sacked++;
+            if (newest < 0 || tx->slots[s & tx->mask].sent_at > tx->slots[newest & tx->mask].sent_at) newest = s;
+            if (s > tx->high_sacked) tx->high_sacked = s;
+            if (bm_test(&tx->retx, s & tx->mask)) acked_retx = 1;
+        }
+    }
+    // RTT sample from the echoed send time, only when the SACK acknowledged new data
+    long rtt = 0;
+    if (newly_acked) {
+        if (acked_retx) tx->rtt.karn_skipped++;
+        else {
+            rtt = (int32_t)(sr_ts_usec() - sk.ts_echo);
+            if (rtt <= 0) rtt = 1;
+            sr_rtt_sample(&tx->rtt, rtt);
+        }
+    }
+    // slide window to the first unacked seq; freed slots are refilled by sr_tx_fill
+    long slid = sr_ring_scan(&tx->acked, tx->mask, tx->base_seq, tx->send_next, 0);
+    tx->sacked -= slid - tx->base_seq;
+    tx->base_seq = slid;
+
+    // congestion control: recovery ends once everything sent before the loss is acked
+    uint64_t now = sr_now_usec();
+    if (tx->in_recovery && tx->base_seq >= tx->recover) tx->in_recovery = 0;
+    if (newly_acked) {
+        sr_ack_sample_t a = { .acked = newly_acked, .rtt = rtt, .srtt = tx->rtt.srtt, .now = now,
+                              .inflight = sr_link_pipe(l), .recovering = tx->in_recovery == SR_REC_FAST };
+        // delivery rate: packets acked (on any stream) since the newest acked packet was sent, over that interval
+        l->delivered += newly_acked;
+        a.delivered = l->delivered;
+        a.prior_delivered = l->delivered;
+        if (newest >= 0) {
+            send_slot_t *ns = &tx->slots[newest & tx->mask];
+            a.prior_delivered = ns->delivered;
+            if (now > ns->delivered_at) a.rate = (double)(l->delivered - ns->delivered) * 1e6 / (now - ns->delivered_at);
+        }
+        l->delivered_at = now;
+        l->cc.ops->on_ack(&l->cc, &a);
+    }
+    if (!tx->in_recovery && tx->base_seq < tx->send_next &&
+        tx->high_sacked >= sr_tx_loss_edge(tx, tx->base_seq) + SR_DUPTHRESH) {
+        // base_seq is a hole with SR_DUPTHRESH SACKed seqs past it (past its FEC group): resend it now
+        tx->in_recovery = SR_REC_FAST;
+        tx->recover = tx->send_next;
+        if (sr_link_cut(l, tx, now)) l->cc.ops->on_loss(&l->cc, now);
+        l->cc.losses++;
+        log_event("%s LOSS stream=%u seq=%ld fast retransmit, cwnd=%.1f ssthresh=%.1f", peer->tag, tx->stream,
+                  tx->base_seq, l->cc.cwnd, l->cc.ssthresh);
+        sr_tx_retransmit(peer, tx, tx->base_seq, now);
+    } else if (tx->in_recovery == SR_REC_FAST && tx->base_seq > old_base && tx->base_seq < tx->send_next) {
+        // partial ACK (NewReno): the next hole is lost as well
+        sr_tx_retransmit(peer, tx, tx->base_seq, now);
+    }
+    log_event("%s CWND cwnd=%.1f ssthresh=%.1f pipe=%ld pacing=%.0fpps", peer->tag, l->cc.cwnd, l->cc.ssthresh,
+              sr_link_pipe(l), l->cc.pacing_rate);
+    return tx->base_seq > old_base;
+}
+
+// ---------- Transfers ----------
+// One file going out on one stream, as a state machine that the stream scheduler
+// (sr_mux_t) steps. A transfer first announces itself (FILE_START, resent until a
+// RESUME frame with its id answers), then sends until every chunk is acked. A
+// transfer nobody answers fails: without a session the receiver drops its data.
+#define SR_XFER_START 0            // FILE_START out, waiting for the receiver's RESUME
+#define SR_XFER_SEND 1
+#define SR_XFER_DONE 2             // everything acked; sr_xfer_close sends FILE_END
+#define SR_XFER_FAILED 3           // no RESUME after SR_START_TRIES; sr_xfer_abort drops it
+
+typedef struct {
+    sr_peer_t *peer;
+    sr_tx_t tx;
+    sr_uring_t ring, *ur;        // -u (sender thread only): file reads, sends and ACK receives
+    sr_rbatch_t *acks;           // batch the ring's receives land in (NULL: the caller reads the socket)
+    char fname[512];
+    long filesize;
+    int state;
+    uint32_t id;                 // transfer id, carried by FILE_START and echoed by RESUME
+    int tries;                   // FILE_STARTs sent so far
+    uint64_t start_due;          // when the next one goes out
+    long long mtime;             // the file's, in ns: ties the receiver's checkpoint to this version of it
+    long first_byte;             // stats: where in the file sending started
+    uint64_t started;
+    struct rusage cpu_start;
+} sr_xfer_t;
+
+// Open fname for sending to peer as `stream` over link; 0 on success. Only range
+// `stripe` of `stripes` equal ranges of its chunks goes out (0 of 1: all of it). acks: the
+// sender thread's SACK batch, which may then run on io_uring for the transfer's lifetime.
+int sr_xfer_open(sr_xfer_t *x, sr_peer_t *peer, sr_link_t *link, uint16_t stream, const char *fname, int stripe,
+                 int stripes, sr_rbatch_t *acks) {
+    memset(x, 0, sizeof(*x));
+    x->peer = peer;
+    x->acks = acks;
+    snprintf(x->fname, sizeof(x->fname), "%s", fname);
+    sr_tx_t *tx = &x->tx;
+    if (sr_tx_alloc(tx, sr_window) < 0) {
+        perror("window alloc");
+        return -1;
+    }
+    tx->stream = stream;
+    tx->out.fd = peer->fd;
+    tx->fec_n = sr_fec_group;
+    if (sr_path_df(peer->fd, 1) < 0) // DF: a path MTU drop shows up as EMSGSIZE (see sr_sbatch_fragment)
+        log_event("%s cannot set DF (%s), packets may be fragmented on the way", peer->tag, strerror(errno));
+    // open file and compute total_chunks
+    tx->fp = fopen(fname, "rb");
+    if (!tx->fp) {
+        perror("fopen send");
+        log_event("%s ERROR: cannot open '%s' for sending", peer->tag, fname);
+        sr_tx_free(tx);
+        return -1;
+    }
+    // the ring lives for one transfer only: its posted receives would otherwise
+    // take the socket's datagrams away from the receiver thread between transfers
+    x->ur = acks ? sr_uring_open(&x->ring, peer->tag) : NULL;
+    if (x->ur) {
+        tx->ring = tx->out.ring = x->ur;
+        sr_rbatch_attach(acks, x->ur, peer->fd);
+        sr_uring_on(x->ur, SR_OP_SEND, sr_sbatch_on_send, &tx->out);
+        sr_uring_on(x->ur, SR_OP_READ, sr_tx_on_read, tx);
+    }
+    if (sr_use_zerocopy && x->ur)
+        log_event("%s MSG_ZEROCOPY is not used with the io_uring backend", peer->tag);
+    else if (sr_use_zerocopy && sr_sbatch_zerocopy(&tx->out) < 0)
+        log_event("%s MSG_ZEROCOPY not available (%s), sends are copied", peer->tag, strerror(errno));
+    // compute file size -> total_chunks
+    fseek(tx->fp, 0, SEEK_END);
+    x->filesize = ftell(tx->fp);
+    struct stat st;
+    if (fstat(fileno(tx->fp), &st) == 0) x->mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    // stripe ranges are cut in CHUNK_SIZE units, whatever chunk each stripe then runs at
+    long units = (x->filesize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    tx->origin = units * stripe / stripes * CHUNK_SIZE;
+    tx->end = units * (stripe + 1) / stripes * CHUNK_SIZE;
+    if (tx->end > x->filesize) tx->end = x->filesize;
+    sr_tx_chunk(tx, sr_path_chunk(peer, tx->win));
+    if (sr_tx_source(peer, tx, x->filesize) < 0) {
+        perror("window alloc");
+        if (x->ur) {
+            sr_rbatch_detach(acks);
+            sr_uring_free(x->ur);
+        }
+        fclose(tx->fp);
+        sr_tx_free(tx);
+        return -1;
+    }
+    x->id = ((uint32_t)sr_now_usec() ^ (uint32_t)getpid() << 16) + stream;
+    if (!x->id) x->id = 1; // 0: sender without an id, never matched as a repeat
+    x->state = SR_XFER_START;
+    sr_link_join(link, tx);
+    return 0;
+}
+
+// the receiver said where to start: chunks below `start` are on its disk already
+void sr_xfer_begin(sr_xfer_t *x, long start) {
+    sr_tx_t *tx = &x->tx;
+    tx->base_seq = tx->send_next = tx->next_seq = tx->read_next = start;
+    tx->skipped = start; // on the receiver's disk already: never sent
+    sr_sbatch_seg(&tx->out, tx->chunk);
+    tx->fec_next = -1; // no group is under way
+    if (tx->fec_n) {
+        sr_fec_init();
+        tx->fec_par = malloc((size_t)SR_FEC_MAX_PARITY * tx->chunk);
+        if (!tx->fec_par) {
+            log_event("%s no memory for FEC parity, sending '%s' without", x->peer->tag, x->fname);
+            tx->fec_n = 0;
+        }
+    }
+    // Seek file to base*chunk
+    fseek(tx->fp, tx->origin + tx->base_seq * tx->chunk, SEEK_SET);
+    log_event("%s Starting send of '%s' on stream %u from chunk %ld (total %ld of %d bytes, cc %s)", x->peer->tag,
+              x->fname, tx->stream, tx->base_seq, tx->total_chunks, tx->chunk, tx->link->cc.ops->name);
+    if (tx->origin || tx->end < x->filesize)
+        log_event("%s STRIPE '%s' bytes %ld..%ld", x->peer->tag, x->fname, tx->origin, tx->end - 1);
+    getrusage(RUSAGE_THREAD, &x->cpu_start);
+    x->started = sr_now_usec();
+    x->first_byte = tx->origin + tx->base_seq * tx->chunk;
+    if (x->first_byte > tx->end) x->first_byte = tx->end;
+    x->state = SR_XFER_SEND;
+}
+
+// a SACK or RESUME frame from the receiver
+void sr_xfer_frame(sr_xfer_t *x, const char *buf, int n) {
+    sr_tx_t *tx = &x->tx;
+    if (x->state == SR_XFER_SEND) {
+        sr_tx_on_sack(x->peer, tx, buf, n);
+        return;
+    }
+    sr_sack_t sk;
+    // anything else is a late SACK of an earlier transfer
+    if (x->state != SR_XFER_START || sr_sack_decode(buf, n, RESUME_MAGIC, &sk) < 0 || sk.ts_echo != x->id ||
+        sk.sid != x->peer->sid || sk.stream != tx->stream)
+        return;
+    long start = (long)sk.cum_ack < tx->total_chunks ? (long)sk.cum_ack : tx->total_chunks;
+    if (sk.nbits && (tx->held = malloc((sk.nbits + 7) / 8))) {
+        memcpy(tx->held, sk.bits, (sk.nbits + 7) / 8);
+        tx->held_from = (long)sk.cum_ack + 1;
+        tx->held_bits = sk.nbits;
+    }
+    sr_xfer_begin(x, start);
+}
+
+// Send FILE_START, padded with NULs to the size of a full data packet: a path that
+// cannot carry the transfer's packets cannot carry it either. -1 (errno EMSGSIZE)
+// if the stack knows the path MTU to be lower already.
+int sr_xfer_announce(sr_xfer_t *x) {
+    sr_peer_t *peer = x->peer;
+    sr_tx_t *tx = &x->tx;
+    char msg[HDR_LEN + SR_MAX_CHUNK];
+    uint32_t sid_net = htonl(peer->sid);
+    memcpy(msg, &sid_net, SID_LEN);
+    int n = SID_LEN + snprintf(msg + SID_LEN, 2048, "%s %s %ld %ld %ld %u %u %ld %ld %d %d %lld", FILE_START_MSG, x->fname,
+                               tx->total_chunks, tx->win, x->filesize, x->id, tx->stream, tx->origin, tx->end,
+                               tx->chunk, tx->fec_n, x->mtime);
+    if (n > SID_LEN + 2047) n = SID_LEN + 2047;
+    if (n < HDR_LEN + tx->chunk) {
+        memset(msg + n, 0, HDR_LEN + tx->chunk - n);
+        n = HDR_LEN + tx->chunk;
+    }
+    return sendto(peer->fd, msg, n, 0, (struct sockaddr *)&peer->addr, peer->len) < 0 ? -1 : 0;
+}
+
+// Do whatever is due at `now` but new transmissions (sr_xfer_send): (re)send
+// FILE_START, load the window, retransmit what timed out.
+void sr_xfer_step(sr_xfer_t *x, uint64_t now) {
+    sr_peer_t *peer = x->peer;
+    sr_tx_t *tx = &x->tx;
+    if (x->state == SR_XFER_START) {
+        if (now < x->start_due) return;
+        if (x->tries < SR_START_TRIES) {
+            // Shrink the chunk to what the stack learnt of the path since (ICMP answers to
+            // the last FILE_START); if half the tries went unanswered at more than
+            // CHUNK_SIZE, those answers are presumably filtered: fall back to CHUNK_SIZE.
+            int chunk = sr_path_chunk(peer, tx->win);
+            if (x->tries >= SR_START_TRIES / 2 && chunk > CHUNK_SIZE) chunk = CHUNK_SIZE;
+            if (chunk < tx->chunk) {
+                log_event("%s PMTU '%s' goes out in chunks of %d bytes instead of %d", peer->tag, x->fname, chunk,
+                          tx->chunk);
+                sr_tx_chunk(tx, chunk);
+                if (!++x->id) x->id = 1; // not a repeat of the FILE_START the receiver may have seen
+            }
+            int err = sr_xfer_announce(x) < 0 ? errno : 0;
+            log_event("%s Sent FILE_START for '%s' total_chunks=%ld window=%ld id=%u stream=%u chunk=%d%s%s", peer->tag,
+                      x->fname, tx->total_chunks, tx->win, x->id, tx->stream, tx->chunk, err ? " failed: " : "",
+                      err ? strerror(err) : "");
+            x->tries++;
+            // EMSGSIZE: the probe knows better by now, try again at once
+            x->start_due = err == EMSGSIZE ? now : now + SR_START_WAIT_USEC;
+            return;
+        }
+        log_event("%s ERROR: no RESUME answer for '%s' after %d FILE_STARTs, not sent", peer->tag, x->fname,
+                  x->tries);
+        printf("[%s] '%s' not sent: the receiver never answered\n", peer->tag, x->fname);
+        x->state = SR_XFER_FAILED;
+        return;
+    }
+    if (x->state != SR_XFER_SEND) return;
+    // continues until all chunks acked (base == total_chunks)
+    if (tx->base_seq >= tx->total_chunks) {
+        x->state = SR_XFER_DONE;
+        return;
+    }
+    if (tx->out.zc) sr_sbatch_zc_reap(&tx->out, 0); // release slots the kernel is done with
+    sr_tx_fill(tx);
+    sr_tx_skip_held(tx);
+    if (tx->base_seq >= tx->total_chunks) { // the rest was on the receiver's disk already
+        x->state = SR_XFER_DONE;
+        return;
+    }
+    sr_tx_expire(peer, tx, now);
+}
+
+// First transmissions in seq order while the shared cwnd (and pacing) allows, at
+// most `quota` of them; they leave with the next sr_sbatch_flush. Returns how many.
+long sr_xfer_send(sr_xfer_t *x, uint64_t now, long quota) {
+    sr_tx_t *tx = &x->tx;
+    sr_link_t *l = tx->link;
+    long sent = 0;
+    if (x->state != SR_XFER_SEND) return 0;
+    while (sent < quota && tx->send_next < tx->next_seq && sr_link_pipe(l) < sr_cc_window(&l->cc) &&
+           sr_link_paced(l, now)) {
+        sr_tx_transmit(x->peer, tx, tx->send_next, now);
+        if (tx->fec_n) sr_tx_fec(x->peer, tx, tx->send_next, now);
+        tx->send_next++;
+        sr_tx_skip_held(tx);
+        sent++;
+    }
+    return sent;
+}
+
+// usec until the transfer needs sr_xfer_step again: the next FILE_START, the earliest
+// retransmission deadline or paced send (0: at once, -1: only a frame can move it on)
+int64_t sr_xfer_wait(const sr_xfer_t *x, uint64_t now) {
+    if (x->state == SR_XFER_START) return x->start_due > now ? (int64_t)(x->start_due - now) : 0;
+    if (x->state != SR_XFER_SEND || x->tx.base_seq >= x->tx.total_chunks) return 0;
+    return sr_tx_next_wait(&x->tx, now);
+}
+
+// Tell the receiver we are done (FILE_END), report and release everything.
+void sr_xfer_close(sr_xfer_t *x) {
+    sr_peer_t *peer = x->peer;
+    sr_tx_t *tx = &x->tx;
+    // All chunks acked; send FILE_END to inform receiver
+    char msg[32];
+    snprintf(msg, sizeof(msg), "%s %u", FILE_END_MSG, tx->stream);
+    sr_send_text(peer, msg);
+    double secs = (sr_now_usec() - x->started) / 1e6;
+    log_event("%s Completed sending '%s' total_chunks=%ld (skipped %ld the receiver had) in %.3fs, %.1f MB/s",
+              peer->tag, x->fname, tx->total_chunks, tx->skipped, secs,
+              secs > 0 ? (tx->end - x->first_byte) / secs / 1e6 : 0.0);
+    printf("[%s] Completed sending '%s'\n", peer->tag, x->fname);
+    sr_rtt_report(peer, x->fname, &tx->rtt);
+    sr_cc_report(peer, x->fname, &tx->link->cc);
+    sr_batch_report(peer, "send", tx->out.calls, tx->out.pkts);
+    if (tx->fec_n)
+        log_event("%s FEC groups=%ld parity=%ld (%d chunks per group, %.1f%% overhead)", peer->tag, tx->fec_groups,
+                  tx->fec_sent, tx->fec_n, tx->total_chunks ? 100.0 * tx->fec_sent / tx->total_chunks : 0.0);
+    if (sr_gso_segs)
+        log_event("%s GSO pkts=%ld datagrams=%ld (%.1f segments each)", peer->tag, tx->out.pkts, tx->out.dgrams,
+                  tx->out.dgrams ? (double)tx->out.pkts / tx->out.dgrams : 0.0);
+    if (x->acks) {
+        sr_batch_report(peer, "acks", x->acks->calls, x->acks->pkts);
+        x->acks->calls = x->acks->pkts = 0;
+    }
+    if (tx->out.zc) {
+        sr_sbatch_zc_wait(&tx->out, tx->out.zc_sent); // nothing may stay pinned once the window is freed
+        log_event("%s ZEROCOPY sends=%u copied=%ld%s", peer->tag, tx->out.zc_sent, tx->out.zc_copied,
+                  tx->out.zc_off ? " (then refused, copying)" : "");
+    }
+    sr_cpu_report(peer, &x->cpu_start, tx->end - x->first_byte, tx->chunk, tx->out.zc && !tx->out.zc_off);
+    if (x->ur) {
+        while (tx->file_ops) sr_uring_wait(x->ur, -1);
+        log_event("%s URING enters=%ld", peer->tag, x->ur->enters);
+        sr_rbatch_detach(x->acks);
+        sr_uring_free(x->ur); // closing it cancels the outstanding receives
+    }
+    sr_link_leave(tx->link, tx);
+    fclose(tx->fp);
+    sr_tx_free(tx);
+}
+
+// Drop the transfer where it is ("exit" while it is still running).
+void sr_xfer_abort(sr_xfer_t *x) {
+    sr_tx_t *tx = &x->tx;
+    if (x->ur) {
+        sr_rbatch_detach(x->acks);
+        sr_uring_free(x->ur);
+    }
+    sr_link_leave(tx->link, tx);
+    fclose(tx->fp);
+    sr_tx_free(tx);
+}
+
+// ---------- Streams ----------
+// The operator's files to one peer. Up to -M of them (default SR_STREAMS) are sent
+// at once, each on a stream of its own: its id is in every data packet, SACK frame
+// and text message, and each has its own seq space, window and timers at both ends
+// (the receiver keeps a session per stream). They share one cwnd (sr_link_t). Each
+// pass hands the room cwnd leaves to the streams in equal shares, round robin, so a
+// large or lossy file cannot hold up a batch of small ones: those get their share
+// from their first round trip and finish on their own. Further names wait in a queue.
+#define SR_MUX_QUEUE 64            // file names waiting for a free stream
+
+typedef struct {
+    sr_peer_t *peer;
+    sr_link_t link;
+    sr_xfer_t *x[SR_MAX_STREAMS]; // streams in flight
+    int n, max;
+    uint16_t next_stream;
+    int rr;                      // stream served first in the next pass
+    char queue[SR_MUX_QUEUE][512];
+    int qhead, qlen;
+    sr_rbatch_t *acks;           // sender thread reading the socket itself (no dispatcher)
+    int stripe, stripes;         // -P: of each file only this range of that many goes out (see Striping)
+} sr_mux_t;
+
+// acks: the socket's SACK batch when the caller reads the socket itself; the
+// transfer may then run it on io_uring, so only one stream is open at a time
+void sr_mux_init(sr_mux_t *m, sr_peer_t *peer, sr_rbatch_t *acks) {
+    m->peer = peer;
+    m->acks = acks;
+    m->max = acks ? 1 : sr_streams;
+    m->stripe = 0;
+    m->stripes = 1 + peer->nstripes;
+}
+
+int sr_mux_busy(const sr_mux_t *m) {
+    return m->n || m->qlen;
+}
+
+// queue a file name; it goes out as soon as a stream is free
+void sr_mux_add(sr_mux_t *m, const char *name) {
+    if (m->qlen == SR_MUX_QUEUE) {
+        log_event("%s ERROR: %d files queued already, dropping '%s'", m->peer->tag, SR_MUX_QUEUE, name);
+        return;
+    }
+    snprintf(m->queue[(m->qhead + m->qlen++) % SR_MUX_QUEUE], sizeof(m->queue[0]), "%s", name);
+}
+
+// a SACK or RESUME frame: its stream field says which transfer it is for
+void sr_mux_frame(sr_mux_t *m, const char *buf, int n) {
+    if (n < SACK_HDR_LEN) return;
+    uint16_t stream_net;
+    memcpy(&stream_net, buf + 8, 2);
+    uint16_t stream = ntohs(stream_net);
+    for (int i = 0; i < m->n; i++) {
+        if (m->x[i]->tx.stream != stream) continue;
+        sr_xfer_frame(m->x[i], buf, n);
+        return;
+    }
+}
+
+// start queued files while streams are free
+void sr_mux_open(sr_mux_t *m) {
+    while (m->n < m->max && m->qlen) {
+        char *name = m->queue[m->qhead];
+        m->qhead = (m->qhead + 1) % SR_MUX_QUEUE;
+        m->qlen--;
+        sr_xfer_t *x = malloc(sizeof(*x));
+        if (!x) {
+            perror("transfer alloc");
+            continue;
+        }
+        if (sr_xfer_open(x, m->peer, &m->link, m->next_stream++, name, m->stripe, m->stripes, m->acks) < 0) {
+            free(x);
+            continue;
+        }
+        if (m->stripe && !x->tx.total_chunks) {
+            // fewer chunks than stripes: this one's range is empty (stripe 0 still creates the file)
+            sr_xfer_abort(x);
+            free(x);
+            continue;
+        }
+        m->x[m->n++] = x;
+    }
+}
+
+// Run every stream: what is due, then new chunks in fair shares of the room cwnd
+// leaves, then one flush each. Returns the usec until the next deadline (0: run
+// again at once, -1: nothing is scheduled, only a frame can move things on).
+int64_t sr_mux_step(sr_mux_t *m, uint64_t now) {
+    sr_mux_open(m);
+    for (int i = 0; i < m->n;) {
+        sr_xfer_t *x = m->x[i];
+        sr_xfer_step(x, now);
+        if (x->state != SR_XFER_DONE && x->state != SR_XFER_FAILED) {
+            i++;
+            continue;
+        }
+        if (x->state == SR_XFER_DONE) sr_xfer_close(x);
+        else sr_xfer_abort(x);
+        free(x);
+        m->x[i] = m->x[--m->n];
+        sr_mux_open(m); // its stream is free for the next file
+    }
+    // equal shares until the room is used up or no stream has anything left to send
+    for (;;) {
+        long room = sr_cc_window(&m->link.cc) - sr_link_pipe(&m->link), sent = 0;
+        if (room <= 0 || !m->n) break;
+        long share = (room + m->n - 1) / m->n;
+        for (int k = 0; k < m->n; k++) sent += sr_xfer_send(m->x[(m->rr + k) % m->n], now, share);
+        if (!sent) break;
+    }
+    if (m->n) m->rr = (m->rr + 1) % m->n;
+    int64_t wait = -1;
+    now = sr_now_usec();
+    for (int i = 0; i < m->n; i++) {
+        sr_sbatch_flush(&m->x[i]->tx.out);
+        int64_t w = sr_xfer_wait(m->x[i], now);
+        if (w >= 0 && (wait < 0 || w < wait)) wait = w;
+    }
+    return wait;
+}
+
+// drop whatever is still in flight or queued ("exit")
+void sr_mux_close(sr_mux_t *m) {
+    for (int i = 0; i < m->n; i++) {
+        sr_xfer_abort(m->x[i]);
+        free(m->x[i]);
+    }
+    m->n = m->qlen = 0;
+}
+
+// Announce m's files (the receiver answers with the resume points), then send until
+// everything is acked; SACK frames come from dispatcher d or, without one, straight
+// from the socket through m->acks.
+void sr_mux_run(sr_mux_t *m, sr_dispatch_t *d) {
+    sr_peer_t *peer = m->peer;
+    while (sr_mux_busy(m)) {
+        int64_t wait = sr_mux_step(m, sr_now_usec());
+        if (wait == 0 || !sr_mux_busy(m)) continue; // a stream that just closed leaves nothing to wait for
+        if (d) {
+            // the dispatcher has sorted the SACK frames out for us
+            sr_qpkt_t *p;
+            if (!sr_pktq_wait(&d->acks, wait)) continue;
+            while ((p = sr_pktq_peek(&d->acks))) {
+                sr_mux_frame(m, p->buf, p->n);
+                sr_pktq_pop(&d->acks);
+            }
+        } else if (sr_rbatch_wait(m->acks, peer->fd, wait) > 0) {
+            // read every SACK frame already queued
+            char *ack;
+            int an;
+            sr_rbatch_recv(m->acks, peer->fd, MSG_DONTWAIT);
+            while (sr_rbatch_next(m->acks, &ack, &an, NULL))
+                sr_mux_frame(m, ack, an);
+        }
+    }
+}
+
+// ---------- Striping (-P) ----------
+// One flow (5-tuple) is hashed to one NIC queue and, at the server, one SO_REUSEPORT
+// worker, so one core receives all of it. With -P n the client opens n - 1 more
+// sockets to the server, each a session of its own (sid + k), and cuts every file
+// into n contiguous chunk ranges: stripe k is an ordinary transfer of its range over
+// socket k (FILE_START says where the range starts), sent by a thread of its own
+// with its own cwnd, and received by whichever worker its flow lands on. The stripes
+// need nothing from each other at either end: each receiving session writes its
+// range at its offsets into the one output file and journals it in a checkpoint of
+// its own. Contiguous ranges rather than seq mod n keep every stripe's writes
+// coalesced and its resume point a prefix.
+typedef struct {
+    sr_mux_t m;
+    sr_rbatch_t acks;            // its socket has no dispatcher: the thread reads it
+    pthread_t thread;
+    int started;
+} sr_stripe_t;
+
+void *stripe_thread(void *arg) {
+    sr_mux_t *m = arg;
+    sr_mux_run(m, sr_dispatch_find(m->peer->fd));
+    return NULL;
+}
+
+// Send stripes 1.. of every file queued on m, each over its socket from a thread of
+// its own; m keeps stripe 0 for the caller. st: room for m->stripes - 1 of them.
+void sr_stripe_start(sr_mux_t *m, sr_stripe_t *st) {
+    for (int k = 1; k < m->stripes; k++) {
+        sr_stripe_t *s = &st[k - 1];
+        sr_peer_t *peer = &m->peer->stripes[k - 1];
+        int own = !sr_dispatch_find(peer->fd);
+        memset(s, 0, sizeof(*s));
+        if (own && sr_rbatch_alloc(&s->acks, sr_batch, sr_gso_segs > 0) < 0) {
+            log_event("%s ERROR: no batch for stripe %d, its part of the files is not sent", peer->tag, k);
+            continue;
+        }
+        s->m = *m; // the same names
+        sr_mux_init(&s->m, peer, own ? &s->acks : NULL);
+        s->m.stripe = k;
+        s->m.stripes = m->stripes;
+        s->started = pthread_create(&s->thread, NULL, stripe_thread, &s->m) == 0;
+        if (!s->started) log_event("%s no thread for stripe %d, sending it afterwards", peer->tag, k);
+    }
+}
+
+// wait for the stripes sr_stripe_start handed out (and send any it found no thread for)
+void sr_stripe_join(sr_mux_t *m, sr_stripe_t *st) {
+    for (int k = 1; k < m->stripes; k++) {
+        sr_stripe_t *s = &st[k - 1];
+        if (s->started) pthread_join(s->thread, NULL);
+        else if (sr_mux_busy(&s->m)) sr_mux_run(&s->m, sr_dispatch_find(s->m.peer->fd));
+        if (s->m.acks == &s->acks) sr_rbatch_free(&s->acks);
+    }
+}
+
+void *sender_thread(void *arg) {
+    sr_peer_t *peer = arg;
+    sr_rbatch_t acks;        // SACKs are drained a batch at a time
+    sr_mux_t *m = calloc(1, sizeof(*m));
+    sr_stripe_t *st = peer->nstripes ? calloc(peer->nstripes, sizeof(*st)) : NULL;
+    if (!m || (peer->nstripes && !st) || sr_rbatch_alloc(&acks, sr_batch, sr_gso_segs > 0) < 0) {
+        perror("batch alloc");
+        free(m);
+        free(st);
+        return NULL;
+    }
+
+    int quit = 0;
+    while (!quit) {
+        printf("\nEnter filename(s) to send (or 'exit'): ");
+        char line[2048], *save;
+        if (!fgets(line, sizeof(line), stdin)) break;
+        // the socket the peer is reached through now (a server follows its latest client)
+        sr_dispatch_t *d = sr_dispatch_find(peer->fd);
+        sr_mux_init(m, peer, d ? NULL : &acks);
+        // every name on the line goes out at once, a stream each
+        for (char *w = strtok_r(line, " \t\r\n", &save); w; w = strtok_r(NULL, " \t\r\n", &save)) {
+            if (strncmp(w, "exit", 4) == 0) {
+                quit = 1;
+                break;
+            }
+            sr_mux_add(m, w);
+        }
+        if (!sr_mux_busy(m)) continue;
+        // -P: the other stripes of every file go out on their own sockets and threads meanwhile
+        sr_stripe_start(m, st);
+        sr_mux_run(m, d);
+        sr_stripe_join(m, st);
+    }
+    if (quit) {
+        sr_send_text(peer, "exit");
+        log_event("%s operator requested exit.", peer->tag);
+    }
+    sr_rbatch_free(&acks);
+    free(m);
+    free(st);
+    return NULL;
+}
+
+// ---------- Reactor (-E) ----------
+// Both directions of every socket on one thread. epoll waits on the sockets, the
+// operator's stdin and one timerfd, armed for the earliest deadline any state
+// machine has (held-back SACK, session sweep, FILE_START resend, retransmission,
+// paced send); an idle program sleeps in epoll_wait until a datagram, a line of
+// input or a deadline. Being the only reader of its sockets, the reactor sorts
+// each datagram: SACK/RESUME frames go to the streams of their session, the rest
+// to the socket's receiver. Transfers run on plain sockets (no -u ring). With -P
+// the stripe sockets are served too, each stripe by a stream scheduler of its own.
+#define SR_EV_STDIN SR_MAX_WORKERS // epoll tags past the socket indexes
+#define SR_EV_TIMER (SR_MAX_WORKERS + 1)
+
+typedef struct {
+    int ep, tfd;
+    sr_receiver_t rx[SR_MAX_WORKERS]; // one per socket
+    int nrx;
+    sr_peer_t *target;           // where the operator's files go
+    sr_mux_t mux[SR_MAX_STRIPES]; // their streams, over target's socket and each of its stripes (-P)
+    int nmux;
+    char input[1024];            // operator input not split into names yet
+    int inlen;
+    int input_open;              // stdin not at EOF
+    int quit;
+    uint64_t armed;              // timerfd deadline (sr_now_usec clock), 0: disarmed
+} sr_reactor_t;
+
+// queue one word of operator input: a file name, or "exit"
+void sr_reactor_word(sr_reactor_t *re, const char *w) {
+    if (strncmp(w, "exit", 4) == 0) {
+        sr_send_text(re->target, "exit");
+        log_event("%s operator requested exit.", re->target->tag);
+        re->quit = 1;
+        return;
+    }
+    for (int k = 0; k < re->nmux; k++) sr_mux_add(&re->mux[k], w);
+}
+
+int sr_reactor_busy(const sr_reactor_t *re) {
+    for (int k = 0; k < re->nmux; k++)
+        if (sr_mux_busy(&re->mux[k])) return 1;
+    return 0;
+}
+
+// read what stdin has and queue every complete word
+void sr_reactor_input(sr_reactor_t *re) {
+    ssize_t r = read(STDIN_FILENO, re->input + re->inlen, sizeof(re->input) - 1 - re->inlen);
+    if (r < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (r <= 0) {
+        re->input_open = 0;
+        epoll_ctl(re->ep, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+        r = 0;
+    }
+    re->inlen += r;
+    re->input[re->inlen] = '\0';
+    char *p = re->input, *end = re->input + re->inlen;
+    for (;;) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        char *w = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        if (p == w) break;
+        if (p == end && re->input_open && re->inlen < (int)sizeof(re->input) - 1) {
+            p = w; // the rest of this word is still to come
+            break;
+        }
+        char c = *p;
+        *p = '\0';
+        sr_reactor_word(re, w);
+        *p = c;
+    }
+    re->inlen = end - p;
+    memmove(re->input, p, re->inlen);
+}
+
+// one batch of datagrams from socket i
+void sr_reactor_socket(sr_reactor_t *re, int i) {
+    sr_receiver_t *r = &re->rx[i];
+    char *buf;
+    int n;
+    struct sockaddr_in from;
+    if (sr_rbatch_recv(&r->rb, r->peer->fd, MSG_DONTWAIT) <= 0) return;
+    while (sr_rbatch_next(&r->rb, &buf, &n, &from)) {
+        if (!sr_is_frame(buf, n)) {
+            sr_receiver_packet(r, buf, n, &from);
+        } else {
+            // stripe k talks as session sid + k
+            uint32_t sid_net;
+            memcpy(&sid_net, buf, SID_LEN);
+            uint32_t k = ntohl(sid_net) - re->target->sid;
+            if (k < (uint32_t)re->nmux) sr_mux_frame(&re->mux[k], buf, n);
+        }
+    }
+}
+
+// Run every state machine whose deadline has come; returns the usec until the
+// next one (0: run again at once, -1: nothing is scheduled).
+int64_t sr_reactor_due(sr_reactor_t *re) {
+    int64_t wait = -1;
+    for (int i = 0; i < re->nrx; i++) {
+        int64_t w = sr_receiver_tick(&re->rx[i]);
+        if (w >= 0 && (wait < 0 || w < wait)) wait = w;
+    }
+    int busy = sr_reactor_busy(re);
+    for (int k = 0; k < re->nmux; k++) {
+        int64_t w = sr_mux_step(&re->mux[k], sr_now_usec());
+        if (w >= 0 && (wait < 0 || w < wait)) wait = w;
+    }
+    if (busy && !sr_reactor_busy(re)) {
+        printf("\nEnter filename(s) to send (or 'exit'): ");
+        fflush(stdout);
+    }
+    return wait;
+}
+
+// Arm the timerfd for `wait` usec from now (-1: no deadline). A timer armed for
+// earlier stays: it only costs one early wakeup, the syscall is saved on every pass.
+void sr_reactor_arm(sr_reactor_t *re, int64_t wait) {
+    if (wait < 0) return;
+    uint64_t due = sr_now_usec() + wait;
+    if (re->armed && re->armed <= due) return;
+    re->armed = due;
+    struct itimerspec it = { .it_value = { (time_t)(due / 1000000), (long)(due % 1000000) * 1000 } };
+    timerfd_settime(re->tfd, TFD_TIMER_ABSTIME, &it, NULL);
+}
+
+// Serve the n sockets of peers[] (receivers, and where SACKs for target come
+// in) and send the files named on stdin to target, until "exit" or the end of
+// input once every queued file is sent. target's stripe sockets are served as well.
+void sr_reactor_run(sr_peer_t *peers, int n, sr_peer_t *target) {
+    sr_reactor_t *re = calloc(1, sizeof(*re));
+    if (!re) {
+        perror("reactor alloc");
+        return;
+    }
+    re->target = target;
+    re->nmux = 1 + target->nstripes;
+    for (int k = 0; k < re->nmux; k++) {
+        sr_mux_init(&re->mux[k], k ? &target->stripes[k - 1] : target, NULL);
+        re->mux[k].stripe = k;
+        re->mux[k].stripes = re->nmux;
+    }
+    re->input_open = 1;
+    re->ep = epoll_create1(0);
+    re->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK); // the clock of sr_now_usec
+    if (re->ep < 0 || re->tfd < 0) {
+        perror("epoll/timerfd");
+        exit(1);
+    }
+    if (sr_use_uring) log_event("%s the reactor does not use the io_uring backend", target->tag);
+    for (int i = 0; i < n + target->nstripes; i++) {
+        sr_peer_t *peer = i < n ? &peers[i] : &target->stripes[i - n];
+        if (sr_receiver_open(&re->rx[i], peer, 0) < 0) exit(1);
+        re->nrx++;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        epoll_ctl(re->ep, EPOLL_CTL_ADD, peer->fd, &ev);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = SR_EV_TIMER };
+    epoll_ctl(re->ep, EPOLL_CTL_ADD, re->tfd, &ev);
+    ev.data.u32 = SR_EV_STDIN;
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    if (epoll_ctl(re->ep, EPOLL_CTL_ADD, STDIN_FILENO, &ev) < 0) {
+        // a regular file can't be polled: it is all there, take it now
+        while (re->input_open) sr_reactor_input(re);
+    }
+    printf("\nEnter filename(s) to send (or 'exit'): ");
+    fflush(stdout);
+
+    while (!re->quit) {
+        int64_t wait = sr_reactor_due(re);
+        if (!re->input_open && !sr_reactor_busy(re)) break; // end of input, everything sent
+        if (wait > 0) sr_reactor_arm(re, wait);
+        struct epoll_event evs[SR_MAX_WORKERS + 2];
+        int k = epoll_wait(re->ep, evs, SR_MAX_WORKERS + 2, wait == 0 ? 0 : -1);
+        for (int e = 0; e < k; e++) {
+            uint32_t tag = evs[e].data.u32;
+            if (tag == SR_EV_TIMER) {
+                uint64_t ticks;
+                if (read(re->tfd, &ticks, sizeof(ticks)) < 0) { /* not expired after all */ }
+                re->armed = 0;
+            } else if (tag == SR_EV_STDIN) {
+                sr_reactor_input(re);
+            } else {
+                sr_reactor_socket(re, tag);
+            }
+        }
+    }
+
+    // "exit" in the middle of transfers, as the sender thread would leave them
+    for (int k = 0; k < re->nmux; k++) sr_mux_close(&re->mux[k]);
+    for (int i = 0; i < re->nrx; i++) sr_receiver_close(&re->rx[i]);
+    close(re->tfd);
+    close(re->ep);
+    free(re);
+}
+
+#endif
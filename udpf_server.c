@@ -8,6 +8,7 @@
 #define SERVER_IP "127.0.0.1"     // Server IP address (localhost)
 #define SERVER_PORT 7600          // Port number for UDP communication
 #define MAX_DATA 1024             // Maximum data per packet
+#define WRITE_BUF (1 << 20)       // Received data reaches the disk in writes of up to 1 MB
 
 // Structure representing a data packet from the client
 struct Packet {
@@ -88,6 +89,7 @@ int main() {
                 perror("File open");
                 exit(1);
             }
+            setvbuf(fp, NULL, _IOFBF, WRITE_BUF);  // One write() per WRITE_BUF bytes, not per packet
             strcpy(current_file, packet.filename);
             printf("[+] Receiving file: %s\n", new_filepath);
         }